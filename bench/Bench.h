@@ -0,0 +1,61 @@
+#ifndef GVKI_BENCH_H
+#define GVKI_BENCH_H
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Helpers shared by the benchmarks
+namespace bench
+{
+
+typedef std::chrono::steady_clock Clock;
+
+inline double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Reports how many ``items`` a second were logged, timed from
+// the last restartExitTimer() until the process exits.
+struct ExitTimer
+{
+    Clock::time_point start;
+    double items;
+    const char* what;
+};
+
+inline ExitTimer& exitTimer()
+{
+    static ExitTimer timer;
+    return timer;
+}
+
+inline void reportExitTimer()
+{
+    ExitTimer& timer = exitTimer();
+    double seconds = secondsSince(timer.start);
+    printf("%.0f %s in %.3f s, %.0f a second (%.1f us each)\n", timer.items, timer.what, seconds,
+           timer.items / seconds, 1e6 * seconds / timer.items);
+}
+
+// The log is written by gvki's writer thread, which the Logger only waits
+// for when it is destroyed at exit. Handlers registered with atexit() run
+// after the destructors of objects constructed after them so this must be
+// called before the first OpenCL call.
+inline void startExitTimer(double items, const char* what)
+{
+    ExitTimer& timer = exitTimer();
+    timer.items = items;
+    timer.what = what;
+    atexit(reportExitTimer);
+    timer.start = Clock::now();
+}
+
+// Start timing again, e.g. once setting up is done
+inline void restartExitTimer()
+{
+    exitTimer().start = Clock::now();
+}
+
+}
+#endif
@@ -0,0 +1,69 @@
+#ifndef GVKI_BENCH_CONTEXT_H
+#define GVKI_BENCH_CONTEXT_H
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Include this after gvki_macro_header.h so the
+// OpenCL calls made here are intercepted too.
+namespace bench
+{
+
+inline void check(cl_int status, const char* what)
+{
+    if (status != CL_SUCCESS)
+    {
+        fprintf(stderr, "%s failed (%d)\n", what, (int) status);
+        exit(1);
+    }
+}
+
+// A context and an in-order queue on the first device of the first platform
+struct Context
+{
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+
+    Context()
+    {
+        cl_platform_id platform;
+        check(clGetPlatformIDs(1, &platform, NULL), "clGetPlatformIDs");
+        check(clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, NULL), "clGetDeviceIDs");
+
+        cl_int status;
+        context = clCreateContext(NULL, 1, &device, NULL, NULL, &status);
+        check(status, "clCreateContext");
+        queue = clCreateCommandQueue(context, device, 0, &status);
+        check(status, "clCreateCommandQueue");
+    }
+
+    cl_program build(const std::string& source, const char* options = NULL)
+    {
+        const char* text = source.c_str();
+        cl_int status;
+        cl_program program = clCreateProgramWithSource(context, 1, &text, NULL, &status);
+        check(status, "clCreateProgramWithSource");
+        check(clBuildProgram(program, 1, &device, options, NULL, NULL), "clBuildProgram");
+        return program;
+    }
+
+    cl_kernel kernel(cl_program program, const char* name)
+    {
+        cl_int status;
+        cl_kernel k = clCreateKernel(program, name, &status);
+        check(status, "clCreateKernel");
+        return k;
+    }
+
+    cl_mem buffer(size_t size)
+    {
+        cl_int status;
+        cl_mem b = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, &status);
+        check(status, "clCreateBuffer");
+        return b;
+    }
+};
+
+}
+#endif
@@ -0,0 +1,91 @@
+// Measures what gvki costs an application while it is disarmed (see
+// GVKI_DISARMED), comparing setting arguments and launching a kernel
+// through the hooks against calling the OpenCL library directly.
+#include "gvki/opencl_header.h"
+
+struct Calls
+{
+    cl_int (*setKernelArg)(cl_kernel, cl_uint, size_t, const void*);
+    cl_int (*enqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t*, const size_t*,
+                                   const size_t*, cl_uint, const cl_event*, cl_event*);
+};
+
+// Defined before gvki_macro_header.h renames the calls to the hooks. The
+// hooks don't use CL_API_CALL so these wrap the real ones.
+static cl_int directSetKernelArg(cl_kernel k, cl_uint index, size_t size, const void* value)
+{
+    return clSetKernelArg(k, index, size, value);
+}
+
+static cl_int directEnqueueNDRangeKernel(cl_command_queue queue, cl_kernel k, cl_uint workDim,
+                                         const size_t* globalOffset, const size_t* globalSize,
+                                         const size_t* localSize, cl_uint waitCount, const cl_event* waitList,
+                                         cl_event* event)
+{
+    return clEnqueueNDRangeKernel(queue, k, workDim, globalOffset, globalSize, localSize, waitCount, waitList,
+                                  event);
+}
+
+static const Calls direct = { &directSetKernelArg, &directEnqueueNDRangeKernel };
+
+#include "gvki_macro_header.h"
+#include "Bench.h"
+#include "Context.h"
+#include <stdlib.h>
+
+using namespace bench;
+
+static const Calls hooked = { &clSetKernelArg, &clEnqueueNDRangeKernel };
+
+static const unsigned Launches = 200000;
+static const unsigned Repeats = 5;
+
+// Returns the seconds taken for Launches launches
+static double time(const Calls& calls, Context& c, cl_kernel k, cl_mem buffer)
+{
+    size_t globalSize = 64;
+    Clock::time_point start = Clock::now();
+    for (unsigned launch = 0; launch < Launches; ++launch)
+    {
+        check(calls.setKernelArg(k, 0, sizeof(cl_mem), &buffer), "clSetKernelArg");
+        check(calls.setKernelArg(k, 1, sizeof(cl_uint), &launch), "clSetKernelArg");
+        check(calls.enqueueNDRangeKernel(c.queue, k, 1, NULL, &globalSize, NULL, 0, NULL, NULL),
+              "clEnqueueNDRangeKernel");
+    }
+    check(clFinish(c.queue), "clFinish");
+    return secondsSince(start);
+}
+
+int main()
+{
+    // Before the first hook creates the Logger
+    setenv("GVKI_DISARMED", "1", 1);
+
+    // Created through the hooks so gvki knows about them as it would
+    Context c;
+    cl_program program = c.build("__kernel void k(__global float* a, uint n) { }");
+    cl_kernel k = c.kernel(program, "k");
+    cl_mem buffer = c.buffer(256);
+
+    // Best of several runs, interleaved so both see the same conditions
+    double best[2] = { 1e9, 1e9 };
+    for (unsigned repeat = 0; repeat < Repeats; ++repeat)
+    {
+        double seconds = time(direct, c, k, buffer);
+        if (seconds < best[0])
+            best[0] = seconds;
+        seconds = time(hooked, c, k, buffer);
+        if (seconds < best[1])
+            best[1] = seconds;
+    }
+
+    printf("%-10s %30s\n", "", "ns per 2 clSetKernelArg + launch");
+    printf("%-10s %30.1f\n", "direct", 1e9 * best[0] / Launches);
+    printf("%-10s %30.1f\n", "disarmed", 1e9 * best[1] / Launches);
+    printf("%-10s %30.1f\n", "overhead", 1e9 * (best[1] - best[0]) / Launches);
+
+    clReleaseMemObject(buffer);
+    clReleaseKernel(k);
+    clReleaseProgram(program);
+    return 0;
+}
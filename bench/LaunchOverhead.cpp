@@ -0,0 +1,62 @@
+// Measures the time clEnqueueNDRangeKernel() takes to log a launch as the
+// number of live buffers grows to 50k. The arguments are looked up by
+// handle so it shouldn't depend on how many buffers there are.
+#include "gvki/opencl_header.h"
+#include "gvki_macro_header.h"
+#include "Bench.h"
+#include "Context.h"
+#include <vector>
+
+using namespace bench;
+
+// Launches timed at each step. Each uses a new kernel
+// object so it is logged with the default GVKI_SAMPLE.
+static const unsigned Launches = 1000;
+
+int main()
+{
+    Context c;
+    cl_program program = c.build("__kernel void k(__global float* a, __global float* b, __global float* c) { }");
+
+    const size_t counts[] = { 100, 1000, 10000, 50000 };
+    std::vector<cl_mem> buffers;
+    printf("%14s %22s\n", "live buffers", "us per logged launch");
+
+    for (unsigned step = 0; step < sizeof(counts) / sizeof(counts[0]); ++step)
+    {
+        while (buffers.size() < counts[step])
+            buffers.push_back(c.buffer(64));
+
+        // Spread the arguments over all the buffers
+        std::vector<cl_kernel> kernels;
+        for (unsigned launch = 0; launch < Launches; ++launch)
+        {
+            cl_kernel k = c.kernel(program, "k");
+            for (cl_uint arg = 0; arg < 3; ++arg)
+            {
+                cl_mem b = buffers[(launch * 7919 + arg) % buffers.size()];
+                check(clSetKernelArg(k, arg, sizeof(cl_mem), &b), "clSetKernelArg");
+            }
+            kernels.push_back(k);
+        }
+
+        size_t globalSize = 64;
+        Clock::time_point start = Clock::now();
+        for (unsigned launch = 0; launch < Launches; ++launch)
+        {
+            check(clEnqueueNDRangeKernel(c.queue, kernels[launch], 1, NULL, &globalSize, NULL, 0, NULL, NULL),
+                  "clEnqueueNDRangeKernel");
+        }
+        double seconds = secondsSince(start);
+        check(clFinish(c.queue), "clFinish");
+
+        printf("%14zu %22.1f\n", buffers.size(), 1e6 * seconds / Launches);
+
+        for (unsigned launch = 0; launch < Launches; ++launch)
+            clReleaseKernel(kernels[launch]);
+    }
+
+    for (size_t index = 0; index < buffers.size(); ++index)
+        clReleaseMemObject(buffers[index]);
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Measures the time taken to log launches from 5k distinct programs. Each
+// program is a large prelude shared by all of them followed by a small
+// kernel of its own, like generated code, so telling the programs apart
+// by comparing their sources would have to get through the whole prelude.
+// Each program is launched several times. Only the first launch writes
+// its kernel file, the rest just find it in the cache of written files.
+#include "gvki/opencl_header.h"
+#include "gvki_macro_header.h"
+#include "Bench.h"
+#include "Context.h"
+#include <sstream>
+#include <vector>
+
+using namespace bench;
+
+static const unsigned Programs = 5000;
+static const unsigned LaunchesPerProgram = 4;
+// Lines of prelude, about 32KB
+static const unsigned PreludeLines = 1000;
+
+int main()
+{
+    startExitTimer(Programs * LaunchesPerProgram, "records written");
+
+    Context c;
+    std::stringstream prelude;
+    for (unsigned line = 0; line < PreludeLines; ++line)
+        prelude << "#define HELPER_" << line << "(x) ((x) * " << line << ")\n";
+
+    // Created first so only logging is timed
+    std::vector<cl_kernel> kernels;
+    for (unsigned index = 0; index < Programs; ++index)
+    {
+        std::stringstream source;
+        source << prelude.str() << "__kernel void k" << index << "(int a) { }\n";
+        cl_program program = c.build(source.str());
+
+        // Each kernel object is logged once with the default GVKI_SAMPLE
+        std::stringstream name;
+        name << "k" << index;
+        for (unsigned launch = 0; launch < LaunchesPerProgram; ++launch)
+        {
+            cl_kernel k = c.kernel(program, name.str().c_str());
+            cl_int value = launch;
+            check(clSetKernelArg(k, 0, sizeof(value), &value), "clSetKernelArg");
+            kernels.push_back(k);
+        }
+        clReleaseProgram(program);
+    }
+
+    restartExitTimer();
+    size_t globalSize = 64;
+    for (unsigned launch = 0; launch < LaunchesPerProgram; ++launch)
+    {
+        for (unsigned index = 0; index < Programs; ++index)
+        {
+            check(clEnqueueNDRangeKernel(c.queue, kernels[index * LaunchesPerProgram + launch], 1, NULL, &globalSize,
+                                         NULL, 0, NULL, NULL),
+                  "clEnqueueNDRangeKernel");
+        }
+    }
+    check(clFinish(c.queue), "clFinish");
+    return 0;
+}
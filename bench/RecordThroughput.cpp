@@ -0,0 +1,47 @@
+// Measures how many kernel invocations a second can be written to
+// log.json. Every launch is logged with eight scalar arguments and two
+// dimensional work sizes and no buffers so the JSON dominates.
+#include "gvki/opencl_header.h"
+#include "gvki_macro_header.h"
+#include "Bench.h"
+#include "Context.h"
+#include <vector>
+
+using namespace bench;
+
+static const unsigned Launches = 20000;
+
+int main()
+{
+    // Everything up to the end of the writer thread at exit is timed
+    startExitTimer(Launches, "records written");
+
+    Context c;
+    cl_program program = c.build("__kernel void k(int a, int b, int c, int d, long e, long f, float g, float h) { }");
+
+    // A kernel object for each launch so they are all logged with the
+    // default GVKI_SAMPLE. They are created first so only logging is timed.
+    std::vector<cl_kernel> kernels;
+    for (unsigned launch = 0; launch < Launches; ++launch)
+    {
+        cl_kernel k = c.kernel(program, "k");
+        for (cl_uint arg = 0; arg < 8; ++arg)
+        {
+            cl_long value = launch * 8 + arg;
+            size_t size = arg == 4 || arg == 5 ? sizeof(cl_long) : sizeof(cl_int);
+            check(clSetKernelArg(k, arg, size, &value), "clSetKernelArg");
+        }
+        kernels.push_back(k);
+    }
+
+    restartExitTimer();
+    size_t globalSize[2] = { 1024, 768 };
+    size_t localSize[2] = { 16, 16 };
+    for (unsigned launch = 0; launch < Launches; ++launch)
+    {
+        check(clEnqueueNDRangeKernel(c.queue, kernels[launch], 2, NULL, globalSize, localSize, 0, NULL, NULL),
+              "clEnqueueNDRangeKernel");
+    }
+    check(clFinish(c.queue), "clFinish");
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Measures the cost of looking up a handle in a HandleRegistry, which is
+// done for every buffer argument of every logged launch, against the
+// std::map count() and operator[] it replaced, with 1k, 100k and 1M
+// handles registered.
+#include "Bench.h"
+#include "gvki/HandleRegistry.h"
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace bench;
+
+// Stands in for a cl_mem. Implementations hand out pointers to
+// their own objects so the handles are spread through the heap.
+struct FakeMem { char object[64]; };
+typedef FakeMem* Handle;
+
+// The same size as BufferInfo
+struct Info
+{
+    size_t size;
+    unsigned long flags;
+    bool hasDestructorCallback;
+    const void* hostPtr;
+    Info() : size(0), flags(0), hasDestructorCallback(false), hostPtr(NULL) { }
+};
+
+static const size_t Lookups = 4000000;
+
+int main()
+{
+    const size_t counts[] = { 1000, 100000, 1000000 };
+    printf("%10s %16s %16s %16s\n", "handles", "std::map (ns)", "lookup() (ns)", "generation (ns)");
+
+    for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        const size_t count = counts[c];
+        std::vector<FakeMem> objects(count);
+        std::map<Handle, Info> map;
+        gvki::HandleRegistry<Handle, Info>* registry = new gvki::HandleRegistry<Handle, Info>();
+        std::vector<uint64_t> generations(count);
+        for (size_t index = 0; index < count; ++index)
+        {
+            Info info;
+            info.size = index;
+            map[&objects[index]] = info;
+            registry->insert(&objects[index], info);
+            generations[index] = registry->generation(&objects[index]);
+        }
+
+        // Launches use buffers in no particular order
+        std::mt19937 random(1);
+        std::vector<size_t> order(Lookups);
+        for (size_t index = 0; index < Lookups; ++index)
+            order[index] = random() % count;
+
+        volatile size_t sink = 0;
+
+        Clock::time_point start = Clock::now();
+        for (size_t index = 0; index < Lookups; ++index)
+        {
+            Handle h = &objects[order[index]];
+            if (map.count(h) == 1)
+                sink += map[h].size;
+        }
+        double mapTime = secondsSince(start);
+
+        start = Clock::now();
+        for (size_t index = 0; index < Lookups; ++index)
+        {
+            if (Info* info = registry->lookup(&objects[order[index]]))
+                sink += info->size;
+        }
+        double lookupTime = secondsSince(start);
+
+        // How kernel arguments are checked when a launch is logged
+        start = Clock::now();
+        for (size_t index = 0; index < Lookups; ++index)
+        {
+            Info info;
+            if (registry->lookup(&objects[order[index]], generations[order[index]], info))
+                sink += info.size;
+        }
+        double generationTime = secondsSince(start);
+
+        printf("%10zu %16.1f %16.1f %16.1f\n", count, 1e9 * mapTime / Lookups,
+               1e9 * lookupTime / Lookups, 1e9 * generationTime / Lookups);
+        delete registry;
+    }
+    return 0;
+}
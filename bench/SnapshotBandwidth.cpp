@@ -0,0 +1,74 @@
+// Measures how fast the contents of buffers passed to logged kernels are
+// written to the logging directory, reading them into memory and writing
+// that out against reading them straight into mapped files. Each way is
+// run in a child process of its own because the Logger reads
+// GVKI_MAPPED_SNAPSHOT_SIZE once.
+#include "gvki/opencl_header.h"
+#include "gvki_macro_header.h"
+#include "Bench.h"
+#include "Context.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace bench;
+
+// Under GVKI_SNAPSHOT_CHUNK_SIZE so the buffer isn't streamed
+static const size_t BufferSize = 32 << 20;
+static const unsigned Launches = 16;
+
+static void run()
+{
+    startExitTimer(Launches * (BufferSize >> 20), "MiB of snapshots written");
+
+    Context c;
+    cl_program program = c.build("__kernel void k(__global float* a) { }");
+    cl_mem buffer = c.buffer(BufferSize);
+    std::vector<cl_kernel> kernels;
+    for (unsigned launch = 0; launch < Launches; ++launch)
+    {
+        cl_kernel k = c.kernel(program, "k");
+        check(clSetKernelArg(k, 0, sizeof(cl_mem), &buffer), "clSetKernelArg");
+        kernels.push_back(k);
+    }
+
+    restartExitTimer();
+    size_t globalSize = 1;
+    for (unsigned launch = 0; launch < Launches; ++launch)
+    {
+        // Change the contents so every launch needs a new snapshot
+        cl_uint value = launch;
+        check(clEnqueueWriteBuffer(c.queue, buffer, CL_TRUE, 0, sizeof(value), &value, 0, NULL, NULL),
+              "clEnqueueWriteBuffer");
+        check(clEnqueueNDRangeKernel(c.queue, kernels[launch], 1, NULL, &globalSize, NULL, 0, NULL, NULL),
+              "clEnqueueNDRangeKernel");
+    }
+    check(clFinish(c.queue), "clFinish");
+}
+
+int main()
+{
+    // The GVKI_MAPPED_SNAPSHOT_SIZE to use
+    const char* ways[][2] = { { "read into memory", "0" }, { "mapped files", "1" } };
+    for (unsigned way = 0; way < sizeof(ways) / sizeof(ways[0]); ++way)
+    {
+        printf("%-18s ", ways[way][0]);
+        fflush(stdout);
+
+        pid_t child = fork();
+        if (child == 0)
+        {
+            setenv("GVKI_MAPPED_SNAPSHOT_SIZE", ways[way][1], 1);
+            run();
+            exit(0);
+        }
+
+        int status;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "Benchmark failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef GVKI_ARMING_H
+#define GVKI_ARMING_H
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+namespace gvki
+{
+
+// Whether kernel launches are being logged. gvki normally always is
+// but it can be started disarmed (see GVKI_DISARMED) and armed while the
+// application runs by a signal or by writing a trigger file. It then
+// stays armed for a number of logged launches or seconds.
+class Arming
+{
+    public:
+        Arming();
+        ~Arming();
+
+        // Start disarmed. Each time gvki is armed it stays armed for
+        // ``launches`` logged launches and ``seconds``, 0 meaning no limit.
+        void configure(uint64_t launches, double seconds);
+        // Arm when the process receives ``signal``. A handler the
+        // application installed for it earlier is still called.
+        void armOnSignal(int signal);
+        // Arm whenever ``path`` is written, created or moved into place.
+        // Returns false and sets ``error`` if it can't be watched.
+        bool armOnTrigger(const std::string& path, std::string& error);
+
+        // Cheap enough for every hook to check first
+        bool armed() const { return armedFlag.load(std::memory_order_relaxed); }
+
+        // Safe to call from a signal handler
+        void arm();
+
+        // Called before deciding whether to log a launch, with the Logger's
+        // logLock held. Returns false, disarming, if the window has closed.
+        // ``justArmed`` is set if this is the first launch since arming.
+        bool windowOpen(bool& justArmed);
+        // Count a launch that was logged, with logLock held
+        void logged();
+
+        bool isDisarmable() const { return disarmable; }
+        unsigned timesArmed() const { return armings; }
+
+    private:
+        std::atomic<bool> armedFlag;
+        std::atomic<bool> armRequested;
+        // Set by configure(), otherwise gvki is always armed
+        bool disarmable;
+
+        uint64_t launchLimit;
+        std::chrono::steady_clock::duration window;
+        // The current window, guarded by logLock
+        uint64_t launchesLeft;
+        std::chrono::steady_clock::time_point windowStart;
+        unsigned armings;
+
+        // The signal armOnSignal() took over, 0 if none
+        int armingSignal;
+
+        // Watches for the trigger file. ``stopPipe`` wakes it up to exit.
+        std::thread watcher;
+        std::string triggerName;
+        int inotifyFd;
+        int stopPipe[2];
+        void watchTrigger();
+
+        Arming(const Arming&); /* = delete; */
+        Arming& operator=(const Arming&); /* = delete; */
+};
+
+}
+#endif
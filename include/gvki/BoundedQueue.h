@@ -0,0 +1,87 @@
+#ifndef GVKI_BOUNDED_QUEUE_H
+#define GVKI_BOUNDED_QUEUE_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace gvki
+{
+
+// A thread safe FIFO queue used to hand work from the threads
+// calling intercepted functions to a background thread.
+template <typename T>
+class BoundedQueue
+{
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false)
+        {
+            if (this->capacity == 0)
+                this->capacity = 1;
+        }
+
+        bool empty() const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return items.empty();
+        }
+
+        bool full() const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return items.size() >= capacity;
+        }
+
+        // Add ``item``, waiting for space if the queue is full
+        void push(const T& item)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            notFull.wait(guard, [this] { return items.size() < capacity; });
+            items.push_back(item);
+            notEmpty.notify_one();
+        }
+
+        // Add ``item`` even if that takes the queue over its capacity
+        void forcePush(const T& item)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            items.push_back(item);
+            notEmpty.notify_one();
+        }
+
+        // Wait for the next item. Returns false once the queue
+        // has been closed and everything in it has been taken.
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            notEmpty.wait(guard, [this] { return !items.empty() || closed; });
+            if (items.empty())
+                return false;
+
+            item = items.front();
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+    private:
+        mutable std::mutex lock;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+
+        BoundedQueue(const BoundedQueue&); /* = delete; */
+        BoundedQueue& operator=(const BoundedQueue&); /* = delete; */
+};
+
+}
+#endif
@@ -0,0 +1,102 @@
+#ifndef GVKI_CAPTURE_FILTER_H
+#define GVKI_CAPTURE_FILTER_H
+#include "gvki/Hash.h"
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace gvki
+{
+
+// A boolean expression over kernel launches (see the README for
+// GVKI_FILTER) that decides which launches are considered for logging.
+// It is compiled into a flat list of instructions with jumps for ``&&``
+// and ``||`` so evaluating it is a single loop. Tests on the kernel's
+// name and sources are done once when the kernel is created and passed
+// back in as a bit mask.
+class CaptureFilter
+{
+    public:
+        // What a launch is tested against
+        struct Launch
+        {
+            // From matchKernel()
+            uint64_t kernelMatches;
+            unsigned workDim;
+            const size_t* globalSize;
+            // NULL if the implementation chooses
+            const size_t* localSize;
+            // Only filled in if needsBufferBytes()
+            uint64_t bufferBytes;
+            // Launches of the entry point before this one
+            uint64_t index;
+        };
+
+        // A test on the work size that takes every dimension into account
+        static const unsigned NoDimension = ~0u;
+
+        CaptureFilter() : bufferBytesUsed(false) { }
+
+        // Compile ``text``. Returns false and sets ``error``, leaving the
+        // filter as it was, if it is malformed.
+        bool configure(const std::string& text, std::string& error);
+        // An empty filter matches everything
+        bool empty() const { return program.empty(); }
+        bool needsBufferBytes() const { return bufferBytesUsed; }
+
+        uint64_t matchKernel(const std::string& entryPointName, const Hash128& sourcesHash) const;
+        bool matches(const Launch& launch) const;
+
+    private:
+        enum Field
+        {
+            WORK_DIM,
+            GLOBAL_SIZE,   // The product over all dimensions
+            LOCAL_SIZE,
+            BUFFER_BYTES,
+            LAUNCH
+        };
+
+        enum Comparison { LT, LE, GT, GE, EQ, NE };
+
+        struct Instruction
+        {
+            enum Op
+            {
+                // Set the result to bit ``operand`` of Launch::kernelMatches
+                TEST_KERNEL,
+                // Set the result to ``field`` (dimension ``operand``, or
+                // all of them if it is NoDimension) ``comparison`` ``value``
+                TEST_FIELD,
+                NOT,
+                // Go to instruction ``operand`` if the result is false/true
+                JUMP_IF_FALSE,
+                JUMP_IF_TRUE
+            };
+            Op op;
+            unsigned operand;
+            Field field;
+            Comparison comparison;
+            uint64_t value;
+        };
+
+        // Tests that only depend on the kernel
+        struct KernelTest
+        {
+            enum Kind { NAME_GLOB, NAME_REGEX, SOURCE_PREFIX };
+            Kind kind;
+            std::string pattern;
+            std::regex regex;
+        };
+
+        std::vector<Instruction> program;
+        std::vector<KernelTest> kernelTests;
+        bool bufferBytesUsed;
+
+        friend class FilterParser;
+};
+
+}
+#endif
@@ -4,8 +4,18 @@
 #include <iostream>
 #include "gvki/GlobalLogFile.h"
 
+namespace gvki
+{
+// Every hook checks this so the environment is only searched once
+inline bool debugEnabled()
+{
+    static const bool enabled = getenv("GVKI_DEBUG") != NULL;
+    return enabled;
+}
+}
+
 // FIXME: These need to be made Windows comptabile
-#define DEBUG(X) if (getenv("GVKI_DEBUG") != NULL) X
+#define DEBUG(X) if (gvki::debugEnabled()) X
 #define DEBUG_MSG(X) DEBUG( std::cerr << "\033[32m***GVKI:" << X  << "***\033[0m" << std::endl); \
                      /* We always want debug messages in the log */ \
                      gvki::GlobalLogFile::singleton() << X << "\n"
@@ -2,6 +2,7 @@
 #define GVKI_GLOBAL_LOG_FILE_H
 
 #include <fstream>
+#include <mutex>
 namespace gvki
 {
 
@@ -9,6 +10,7 @@ class GlobalLogFile
 {
     private:
         std::ofstream output;
+        std::mutex outputLock;
     public:
         GlobalLogFile();
         GlobalLogFile(const GlobalLogFile&); /* = delete; */
@@ -24,6 +26,7 @@ class GlobalLogFile
         {
             if (output.is_open())
             {
+                std::lock_guard<std::mutex> guard(outputLock);
                 output << rhs;
                 output.flush();
             }
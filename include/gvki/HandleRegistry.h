@@ -0,0 +1,507 @@
+#ifndef GVKI_HANDLE_REGISTRY_H
+#define GVKI_HANDLE_REGISTRY_H
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace gvki
+{
+
+// Generations for HandleRegistry entries. There is one counter for every
+// registry so a generation identifies an object whichever registry it is in.
+// Never returns 0.
+inline uint64_t nextHandleGeneration()
+{
+    static std::atomic<uint64_t> counter(0);
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// A thread safe map from an opaque OpenCL handle (e.g. cl_mem, cl_kernel)
+// to the information we recorded about it.
+//
+// Handles are sharded by hash so threads registering unrelated objects do
+// not contend on a single lock. Each shard is a flat, linearly probed table
+// where every slot holds the handle itself next to a pointer to its
+// information, so probing compares handles without chasing pointers.
+// Writers serialise on the shard's lock but lookups never take a lock, they
+// just probe the currently published table.
+//
+// The information lives in chunks owned by the shard and never moves so the
+// pointer returned by lookup() stays valid for as long as the handle stays
+// registered. Information that can change once registered must only be
+// changed with update() and read with the copying lookup(), which both hold
+// the shard's lock, so readers never see a half written std::string. Tables are only ever replaced by bigger ones when growing and
+// the old ones are kept until the registry dies so a concurrent lookup never
+// probes freed memory. As the tables double in size this costs at most as
+// much memory again as the largest table.
+//
+// Each entry counts the references the application holds on the handle so
+// the caller can tell when to erase() it. Erasing shifts later entries of
+// the probe sequence back rather than leaving a tombstone so the table never
+// fills up with dead slots. Lookups can't see that happen atomically so
+// each shard has a sequence number, odd while an erase is in progress, and
+// a lookup that fails while an erase overlapped it is retried.
+//
+// Implementations recycle handles once objects are destroyed so a handle on
+// its own doesn't say which object it named. Every registration is given a
+// generation, unique across all registries, that is cleared when the entry
+// is erased. A (handle, generation) pair recorded earlier can be checked in
+// constant time with the lookup() overload taking a generation.
+template <typename Handle, typename Info>
+class HandleRegistry
+{
+    public:
+        HandleRegistry() : live(0), evicted(0)
+        {
+            for (unsigned index=0; index < NumShards; ++index)
+                shards[index].table.store(new Table(InitialSlots), std::memory_order_relaxed);
+        }
+
+        ~HandleRegistry()
+        {
+            for (unsigned index=0; index < NumShards; ++index)
+            {
+                Shard& s = shards[index];
+                delete s.table.load(std::memory_order_relaxed);
+
+                for (size_t r=0; r < s.retired.size(); ++r)
+                    delete s.retired[r];
+
+                for (size_t c=0; c < s.chunks.size(); ++c)
+                    delete [] s.chunks[c];
+            }
+        }
+
+        // Returns the information recorded for ``h`` or NULL if ``h`` isn't
+        // registered. This never blocks. Reading through the pointer is only
+        // safe for information that doesn't change once registered, or that
+        // OpenCL already forbids using from several threads at once (e.g. a
+        // kernel's arguments).
+        Info* lookup(Handle h) const
+        {
+            Entry* found = probe(h);
+            return found != NULL ? &(found->info) : NULL;
+        }
+
+        // Copy the information recorded for ``h`` into ``info``. Returns
+        // false if ``h`` isn't registered. This takes the shard's lock so
+        // it can't race with update().
+        bool lookup(Handle h, Info& info)
+        {
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Entry* e = find(s, hash, h);
+            if (e == NULL)
+                return false;
+
+            info = e->info;
+            return true;
+        }
+
+        // Call ``change`` with the information recorded for ``h`` while
+        // holding the shard's lock. Returns false if ``h`` isn't registered.
+        template <typename Function>
+        bool update(Handle h, Function change)
+        {
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Entry* e = find(s, hash, h);
+            if (e == NULL)
+                return false;
+
+            change(e->info);
+            return true;
+        }
+
+        // Copy the information recorded for ``h`` into ``info`` if ``h`` is
+        // still registered under ``generation``, i.e. it still names the
+        // same object it did when generation() returned ``generation``.
+        // Unlike the pointer returned by lookup() the copy can't be changed
+        // under us by a concurrent erase. This doesn't lock, the generation
+        // is checked again afterwards instead, so Info must be plain data
+        // (e.g. BufferInfo) that can be copied while it is being overwritten.
+        bool lookup(Handle h, uint64_t generation, Info& info) const
+        {
+            if (generation == 0)
+                return false;
+
+            Entry* found = probe(h);
+            if (found == NULL || found->generation.load(std::memory_order_acquire) != generation)
+                return false;
+
+            info = found->info;
+
+            // If the entry was erased (and maybe reused) while we copied
+            // the copy might be torn
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return found->generation.load(std::memory_order_relaxed) == generation;
+        }
+
+        // The generation ``h`` is currently registered under or 0 if it
+        // isn't registered. This never blocks.
+        uint64_t generation(Handle h) const
+        {
+            Entry* found = probe(h);
+            return found != NULL ? found->generation.load(std::memory_order_acquire) : 0;
+        }
+
+        // Record ``info`` for ``h`` holding a single reference. If ``h`` was
+        // already registered (i.e. the implementation reused the handle)
+        // the old information is overwritten. The information should be
+        // fully initialised before calling this because other threads can
+        // see it as soon as this returns. NULL marks empty slots so it
+        // can't be registered; nothing happens and NULL is returned.
+        Info* insert(Handle h, const Info& info)
+        {
+            if (h == EmptyKey)
+                return NULL;
+
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Table* t = s.table.load(std::memory_order_relaxed);
+            size_t slot = hash & t->mask;
+            for (Handle key; (key = t->slots[slot].key.load(std::memory_order_relaxed)) != EmptyKey; slot = (slot + 1) & t->mask)
+            {
+                if (key == h)
+                {
+                    // This is a new object so anything that recorded the
+                    // old generation must not see the new information
+                    Entry* existing = t->slots[slot].entry.load(std::memory_order_relaxed);
+                    existing->generation.store(0, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    existing->info = info;
+                    existing->references = 1;
+                    existing->generation.store(nextHandleGeneration(), std::memory_order_release);
+                    return &(existing->info);
+                }
+            }
+
+            Entry* newEntry = s.allocate();
+            newEntry->handle.store(h, std::memory_order_relaxed);
+            newEntry->info = info;
+            newEntry->references = 1;
+            newEntry->generation.store(nextHandleGeneration(), std::memory_order_release);
+
+            // The entry must be visible before the key is because lookups
+            // only synchronise on the key
+            t->slots[slot].entry.store(newEntry, std::memory_order_relaxed);
+            t->slots[slot].key.store(h, std::memory_order_release);
+            ++s.count;
+            live.fetch_add(1, std::memory_order_relaxed);
+
+            // Keep the load factor below a half so probe sequences stay short
+            if (2 * s.count > t->mask)
+                grow(s);
+
+            return &(newEntry->info);
+        }
+
+        // Note that the application took another reference to ``h``.
+        // Returns false if ``h`` isn't registered.
+        bool retain(Handle h)
+        {
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Entry* e = find(s, hash, h);
+            if (e == NULL)
+                return false;
+
+            ++e->references;
+            return true;
+        }
+
+        // Note that the application gave up a reference to ``h``. Returns
+        // true if that was its last one. The entry is not erased.
+        bool release(Handle h)
+        {
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Entry* e = find(s, hash, h);
+            if (e == NULL || e->references == 0)
+                return false;
+
+            return --e->references == 0;
+        }
+
+        // Forget ``h``, freeing everything its information owns. Returns
+        // false if ``h`` isn't registered. Pointers previously returned by
+        // lookup(h) must not be used after this.
+        bool erase(Handle h)
+        {
+            if (h == EmptyKey)
+                return false;
+
+            const uint64_t hash = hashHandle(h);
+            Shard& s = shardFor(hash);
+            std::lock_guard<std::mutex> guard(s.writeLock);
+
+            Table* t = s.table.load(std::memory_order_relaxed);
+            size_t hole = hash & t->mask;
+            for (Handle key; (key = t->slots[hole].key.load(std::memory_order_relaxed)) != h; hole = (hole + 1) & t->mask)
+            {
+                if (key == EmptyKey)
+                    return false;
+            }
+            Entry* erased = t->slots[hole].entry.load(std::memory_order_relaxed);
+
+            // Tell lookups the table is changing
+            unsigned sequence = s.sequence.load(std::memory_order_relaxed);
+            s.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            // Move back any later entry of the run whose probe sequence
+            // passes through the hole, then the hole left by that entry,
+            // and so on.
+            for (size_t slot = (hole + 1) & t->mask; ; slot = (slot + 1) & t->mask)
+            {
+                Handle key = t->slots[slot].key.load(std::memory_order_relaxed);
+                if (key == EmptyKey)
+                    break;
+
+                size_t home = hashHandle(key) & t->mask;
+                if (((slot - home) & t->mask) >= ((slot - hole) & t->mask))
+                {
+                    t->slots[hole].entry.store(t->slots[slot].entry.load(std::memory_order_relaxed), std::memory_order_release);
+                    t->slots[hole].key.store(key, std::memory_order_relaxed);
+                    hole = slot;
+                }
+            }
+            t->slots[hole].key.store(EmptyKey, std::memory_order_relaxed);
+            t->slots[hole].entry.store(NULL, std::memory_order_relaxed);
+
+            s.sequence.store(sequence + 2, std::memory_order_release);
+
+            --s.count;
+            live.fetch_sub(1, std::memory_order_relaxed);
+            evicted.fetch_add(1, std::memory_order_relaxed);
+
+            // Free what the information owns now rather than when the
+            // entry gets reused. Lookups still holding the entry must see
+            // the generation change before the information does.
+            erased->generation.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            erased->handle.store(EmptyKey, std::memory_order_relaxed);
+            erased->info = Info();
+            erased->references = 0;
+            s.freeEntries.push_back(erased);
+            return true;
+        }
+
+        // Number of handles currently registered
+        size_t liveCount() const { return live.load(std::memory_order_relaxed); }
+
+        // Number of handles erased so far
+        size_t evictedCount() const { return evicted.load(std::memory_order_relaxed); }
+
+    private:
+        static const unsigned ShardBits = 4;
+        static const unsigned NumShards = 1 << ShardBits;
+        // Must be a power of two
+        static const size_t InitialSlots = 64;
+        // Number of Info objects allocated at a time
+        static const size_t ChunkSize = 64;
+
+        static constexpr Handle EmptyKey = NULL;
+
+        struct Entry
+        {
+            std::atomic<Handle> handle;
+            // 0 while the entry is free
+            std::atomic<uint64_t> generation;
+            Info info;
+            // References the application holds on the handle
+            unsigned references;
+
+            Entry() : handle(EmptyKey), generation(0), references(0) { }
+        };
+
+        struct Slot
+        {
+            std::atomic<Handle> key;
+            std::atomic<Entry*> entry;
+        };
+
+        struct Table
+        {
+            const size_t mask;
+            Slot* slots;
+
+            explicit Table(size_t numSlots) : mask(numSlots - 1), slots(new Slot[numSlots])
+            {
+                assert( (numSlots & mask) == 0 && "numSlots must be a power of 2");
+                for (size_t slot=0; slot < numSlots; ++slot)
+                {
+                    slots[slot].key.store(EmptyKey, std::memory_order_relaxed);
+                    slots[slot].entry.store(NULL, std::memory_order_relaxed);
+                }
+            }
+
+            ~Table() { delete [] slots; }
+        };
+
+        // Pad to a cache line so writers to different shards
+        // don't fight over the same line.
+        struct alignas(64) Shard
+        {
+            std::atomic<Table*> table;
+            // Odd while an erase is moving entries
+            std::atomic<unsigned> sequence;
+            std::mutex writeLock;
+            size_t count;
+            std::vector<Table*> retired;
+
+            // Storage for the entries. The chunks are never
+            // reallocated so entries never move.
+            std::vector<Entry*> chunks;
+            size_t usedInLastChunk;
+            // Erased entries waiting to be reused
+            std::vector<Entry*> freeEntries;
+
+            Shard() : table(NULL), sequence(0), count(0), usedInLastChunk(ChunkSize) { }
+
+            // Must be called with writeLock held
+            Entry* allocate()
+            {
+                if (!freeEntries.empty())
+                {
+                    Entry* e = freeEntries.back();
+                    freeEntries.pop_back();
+                    return e;
+                }
+
+                if (usedInLastChunk == ChunkSize)
+                {
+                    chunks.push_back(new Entry[ChunkSize]);
+                    usedInLastChunk = 0;
+                }
+                return &(chunks.back()[usedInLastChunk++]);
+            }
+        };
+
+        Shard shards[NumShards];
+        std::atomic<size_t> live;
+        std::atomic<size_t> evicted;
+
+        HandleRegistry(const HandleRegistry&); /* = delete; */
+        HandleRegistry& operator=(const HandleRegistry&); /* = delete; */
+
+        // Handles are pointers so their low bits are mostly zero. Mix
+        // them so both the shard index and the slot index are usable.
+        static uint64_t hashHandle(Handle h)
+        {
+            uint64_t x = (uint64_t) (uintptr_t) h;
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            return x;
+        }
+
+        // The shard is picked with the top bits of the hash, the slot with the
+        // bottom bits, so the two don't correlate.
+        Shard& shardFor(uint64_t hash) { return shards[hash >> (64 - ShardBits)]; }
+        const Shard& shardFor(uint64_t hash) const { return shards[hash >> (64 - ShardBits)]; }
+
+        // The entry for ``h`` or NULL. This is the lock free probe behind
+        // the lookup functions.
+        Entry* probe(Handle h) const
+        {
+            // NULL is never registered (it marks empty slots)
+            if (h == EmptyKey)
+                return NULL;
+
+            const uint64_t hash = hashHandle(h);
+            const Shard& s = shardFor(hash);
+            while (true)
+            {
+                unsigned sequence = s.sequence.load(std::memory_order_acquire);
+                const Table* t = s.table.load(std::memory_order_acquire);
+                for (size_t slot = hash & t->mask; ; slot = (slot + 1) & t->mask)
+                {
+                    Handle key = t->slots[slot].key.load(std::memory_order_acquire);
+                    if (key == h)
+                    {
+                        // An erase might have replaced the slot's entry since
+                        // we read the key but entries know their own handle
+                        Entry* found = t->slots[slot].entry.load(std::memory_order_acquire);
+                        if (found->handle.load(std::memory_order_relaxed) == h)
+                            return found;
+                        break;
+                    }
+
+                    if (key == EmptyKey)
+                    {
+                        // If an erase moved entries around while we were
+                        // probing we might have missed ``h``
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if ((sequence & 1) == 0 && s.sequence.load(std::memory_order_relaxed) == sequence)
+                            return NULL;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Must be called with the shard's lock held
+        Entry* find(Shard& s, uint64_t hash, Handle h)
+        {
+            if (h == EmptyKey)
+                return NULL;
+
+            Table* t = s.table.load(std::memory_order_relaxed);
+            for (size_t slot = hash & t->mask; ; slot = (slot + 1) & t->mask)
+            {
+                Handle key = t->slots[slot].key.load(std::memory_order_relaxed);
+                if (key == h)
+                    return t->slots[slot].entry.load(std::memory_order_relaxed);
+
+                if (key == EmptyKey)
+                    return NULL;
+            }
+        }
+
+        // Must be called with the shard's lock held
+        void grow(Shard& s)
+        {
+            Table* old = s.table.load(std::memory_order_relaxed);
+            Table* bigger = new Table(2 * (old->mask + 1));
+
+            for (size_t slot=0; slot <= old->mask; ++slot)
+            {
+                Handle key = old->slots[slot].key.load(std::memory_order_relaxed);
+                if (key == EmptyKey)
+                    continue;
+
+                size_t newSlot = hashHandle(key) & bigger->mask;
+                while (bigger->slots[newSlot].key.load(std::memory_order_relaxed) != EmptyKey)
+                    newSlot = (newSlot + 1) & bigger->mask;
+
+                bigger->slots[newSlot].entry.store(old->slots[slot].entry.load(std::memory_order_relaxed),
+                                                   std::memory_order_relaxed);
+                bigger->slots[newSlot].key.store(key, std::memory_order_relaxed);
+            }
+
+            // Publish. Lookups already probing the old table can carry on
+            // because it stays allocated and is never modified again.
+            s.table.store(bigger, std::memory_order_release);
+            s.retired.push_back(old);
+        }
+};
+
+template <typename Handle, typename Info>
+constexpr Handle HandleRegistry<Handle, Info>::EmptyKey;
+
+}
+#endif
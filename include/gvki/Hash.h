@@ -0,0 +1,57 @@
+#ifndef GVKI_HASH_H
+#define GVKI_HASH_H
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace gvki
+{
+
+struct Hash128
+{
+    uint64_t high;
+    uint64_t low;
+
+    Hash128() : high(0), low(0) { }
+
+    bool operator==(const Hash128& other) const { return high == other.high && low == other.low; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+    bool operator<(const Hash128& other) const
+    {
+        return high < other.high || (high == other.high && low < other.low);
+    }
+
+    // 32 lower case hex digits
+    std::string toHex() const;
+};
+
+// Computes a 128-bit MurmurHash3 (the x64_128 variant) of data that
+// arrives in pieces. This is not a cryptographic hash, it is only used to
+// spot identical data.
+class Hasher
+{
+    public:
+        explicit Hasher(uint64_t seed = 0);
+        void update(const void* data, size_t size);
+        Hash128 finish() const;
+
+        static Hash128 hash(const void* data, size_t size)
+        {
+            Hasher h;
+            h.update(data, size);
+            return h.finish();
+        }
+
+    private:
+        uint64_t h1;
+        uint64_t h2;
+        uint64_t totalSize;
+        // Bytes that don't make up a full block yet
+        unsigned char tail[16];
+        size_t tailSize;
+
+        void mixBlock(const unsigned char* block);
+};
+
+}
+#endif
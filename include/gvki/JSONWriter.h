@@ -0,0 +1,87 @@
+#ifndef GVKI_JSON_WRITER_H
+#define GVKI_JSON_WRITER_H
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <stdint.h>
+
+namespace gvki
+{
+
+// Writes the log to a file. Output is collected in a large buffer and only
+// written out when the buffer fills up or flush() is called, unlike
+// std::endl which flushes every line. Numbers are formatted with lookup
+// tables rather than through the stream's locale aware machinery.
+class JSONWriter
+{
+    public:
+        explicit JSONWriter(const char* path);
+        ~JSONWriter();
+
+        bool good() const { return file.good(); }
+
+        JSONWriter& operator<<(const char* s) { append(s, strlen(s)); return *this; }
+        JSONWriter& operator<<(const std::string& s) { append(s.data(), s.size()); return *this; }
+        JSONWriter& operator<<(char c)
+        {
+            if (used == BufferSize)
+                flush();
+            buffer[used++] = c;
+            return *this;
+        }
+
+        JSONWriter& operator<<(unsigned value) { writeUnsigned(value); return *this; }
+        JSONWriter& operator<<(unsigned long value) { writeUnsigned(value); return *this; }
+        JSONWriter& operator<<(unsigned long long value) { writeUnsigned(value); return *this; }
+
+        // Write ``s`` as a quoted JSON string, escaping it as necessary
+        void writeString(const std::string& s);
+
+        // Write ``size`` bytes as lower case hex digits starting from the
+        // last byte, i.e. the value of a little endian integer.
+        void writeHexReversed(const unsigned char* bytes, size_t size);
+
+        // Write everything buffered so far to the file
+        void flush();
+        void close();
+
+        // Collect what is written in ``target`` instead of
+        // the file until endCapture() is called
+        void beginCapture(std::string& target);
+        void endCapture();
+
+    private:
+        static const size_t BufferSize = 1 << 20;
+        std::ofstream file;
+        char* buffer;
+        size_t used;
+        // Set between beginCapture() and endCapture()
+        std::string* capture;
+
+        void append(const char* data, size_t size)
+        {
+            if (used + size > BufferSize)
+            {
+                flush();
+                if (size > BufferSize)
+                {
+                    writeOut(data, size);
+                    return;
+                }
+            }
+            memcpy(buffer + used, data, size);
+            used += size;
+        }
+
+        void writeUnsigned(uint64_t value);
+        void writeOut(const char* data, size_t size);
+        // Hand the buffer to writeOut()
+        void drain();
+
+        JSONWriter(const JSONWriter&); /* = delete; */
+        JSONWriter& operator=(const JSONWriter&); /* = delete; */
+};
+
+}
+#endif
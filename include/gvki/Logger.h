@@ -1,7 +1,22 @@
 #ifndef SHADOW_CONTEXT_H
 #define SHADOW_CONTEXT_H
 #include "gvki/opencl_header.h"
+#include "gvki/Arming.h"
+#include "gvki/BoundedQueue.h"
+#include "gvki/CaptureFilter.h"
+#include "gvki/HandleRegistry.h"
+#include "gvki/Hash.h"
+#include "gvki/JSONWriter.h"
+#include "gvki/MemoryBudget.h"
+#include "gvki/Sampler.h"
+#include "gvki/SnapshotPool.h"
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <string>
 #include <vector>
 #include <fstream>
@@ -12,9 +27,111 @@ namespace gvki
 struct BufferInfo
 {
     size_t size;
-    void* data;
     cl_mem_flags flags;
-    BufferInfo() : size(0), data(0), flags(0) {}
+    // If set the entry is evicted when the implementation destroys the
+    // buffer rather than when the application releases it
+    bool hasDestructorCallback;
+    // The application's memory backing a CL_MEM_USE_HOST_PTR buffer
+    const void* hostPtr;
+    BufferInfo() : size(0), flags(0), hasDestructorCallback(false), hostPtr(NULL) {}
+};
+
+// What the writer thread needs to stream a buffer too big to hold in
+// memory to a file (see Logger::streamSnapshot())
+struct PendingStream
+{
+    // The reads are done on the writer thread's queue for these
+    cl_context context;
+    cl_device_id device;
+    // A marker on the application's queue the reads wait for
+    cl_event after;
+    // Two blocks of ``chunkSize`` bytes the chunks are read into
+    char* chunks[2];
+    size_t chunkSize;
+    // Set once the kernel has been let go
+    bool completed;
+    PendingStream() : context(NULL), device(NULL), after(NULL), chunkSize(0), completed(false)
+    {
+        chunks[0] = chunks[1] = NULL;
+    }
+};
+
+// A copy of a buffer's contents taken just before a kernel
+// that reads it was enqueued. Later kernels share it for as
+// long as the buffer isn't written to.
+struct BufferSnapshot
+{
+    cl_mem memObject;
+    size_t size;
+    // Freed by the writer thread once it has been written
+    char* data;
+    // Relative to the logging directory. Set once the
+    // data has arrived because it's named after its contents.
+    std::string fileName;
+    // If not NULL the read filling ``data`` might not have finished
+    // yet. We hold a reference to it until the snapshot is destroyed.
+    cl_event readEvent;
+    // If set ``data`` is a mapping of a file rather than heap memory
+    bool mapped;
+    // A file that hasn't been given its final name yet. It is removed
+    // with the snapshot if it turns out to be a duplicate.
+    std::string temporaryFile;
+    // Set if the snapshot was streamed to ``temporaryFile`` and
+    // hashed on the way. ``data`` is NULL then.
+    bool hashed;
+    Hash128 contents;
+    // Where ``data`` came from, unless it is mapped
+    SnapshotPool* pool;
+    // If not NULL the snapshot is still on the device, in a buffer of
+    // ours in ``shadowContext``. ``readEvent`` is the copy into it.
+    // It is reserved in ``shadowMemory`` until it is released.
+    cl_mem shadow;
+    cl_context shadowContext;
+    cl_device_id shadowDevice;
+    MemoryBudget* shadowMemory;
+    // If not NULL the writer thread still has to stream the snapshot.
+    // ``readEvent`` is then a user event the kernel waits for, which is
+    // completed once the last chunk has been read. We hold a reference
+    // to ``memObject`` until then and ``pool`` holds the chunks.
+    PendingStream* stream;
+
+    // ``data`` is a block from ``pool``
+    BufferSnapshot(cl_mem memObject, size_t size, char* data, SnapshotPool* pool) :
+        memObject(memObject), size(size), data(data), readEvent(NULL),
+        mapped(false), hashed(false), pool(pool), shadow(NULL), stream(NULL) { }
+    // Takes ownership of ``data``, a mapping of ``temporaryFile``
+    BufferSnapshot(cl_mem memObject, size_t size, char* data, const std::string& temporaryFile) :
+        memObject(memObject), size(size), data(data), readEvent(NULL),
+        mapped(true), temporaryFile(temporaryFile), hashed(false), pool(NULL), shadow(NULL), stream(NULL) { }
+    // ``temporaryFile`` already holds the snapshot
+    BufferSnapshot(cl_mem memObject, size_t size, const std::string& temporaryFile, const Hash128& contents) :
+        memObject(memObject), size(size), data(NULL), readEvent(NULL),
+        mapped(false), temporaryFile(temporaryFile), hashed(true), contents(contents), pool(NULL), shadow(NULL),
+        stream(NULL) { }
+    // Takes ownership of ``shadow``
+    BufferSnapshot(cl_mem memObject, size_t size, cl_mem shadow, cl_context shadowContext,
+                   cl_device_id shadowDevice, MemoryBudget* shadowMemory) :
+        memObject(memObject), size(size), data(NULL), readEvent(NULL),
+        mapped(false), hashed(false), pool(NULL), shadow(shadow), shadowContext(shadowContext),
+        shadowDevice(shadowDevice), shadowMemory(shadowMemory), stream(NULL) { }
+    // Takes ownership of ``stream``, whose chunks are from ``pool``
+    BufferSnapshot(cl_mem memObject, size_t size, PendingStream* stream, SnapshotPool* pool) :
+        memObject(memObject), size(size), data(NULL), readEvent(NULL),
+        mapped(false), hashed(false), pool(pool), shadow(NULL), stream(stream) { }
+    ~BufferSnapshot();
+
+    // Free ``data``. Only the file name is needed once it has been written.
+    void releaseData();
+    void releaseShadow();
+    // Let the kernel go, even if the stream failed, and give back what
+    // the stream held
+    void releaseStream();
+    // Exchange the data (wherever it is held) with ``other``
+    void swapContents(BufferSnapshot& other);
+
+    private:
+    BufferSnapshot(const BufferSnapshot&); /* = delete; */
+    BufferSnapshot& operator=(const BufferSnapshot&); /* = delete; */
 };
 
 struct ImageInfo
@@ -22,6 +139,9 @@ struct ImageInfo
    // TODO: Add more fields describing the image
    cl_mem_flags flags;
    cl_mem_object_type type;
+   // See BufferInfo::hasDestructorCallback
+   bool hasDestructorCallback;
+   ImageInfo() : flags(0), type(0), hasDestructorCallback(false) {}
 };
 
 struct SamplerInfo
@@ -31,6 +151,41 @@ struct SamplerInfo
     cl_filter_mode filter_mode;
 };
 
+// What we know about the contents of a buffer passed to a logged kernel
+struct BufferHistory
+{
+    // Commands enqueued so far that might have changed the contents
+    uint64_t writes;
+    // Such commands being enqueued right now
+    unsigned writesInProgress;
+    // Where the last of ``writes`` was enqueued. Only a snapshot read
+    // through the same queue is certain to come after it.
+    cl_command_queue lastWriteQueue;
+    // The contents since the last of ``writes``, if we have them
+    std::shared_ptr<BufferSnapshot> snapshot;
+    // Set if the buffer can change without us seeing a command
+    // that writes it (e.g. through an image created from it)
+    bool untracked;
+
+    BufferHistory() : writes(0), writesInProgress(0), lastWriteQueue(NULL), untracked(false) { }
+};
+
+// Properties of a device that kernels were enqueued on. These
+// can't change so they are only queried once per device.
+struct DeviceInfo
+{
+    // Index into the device table
+    unsigned id;
+    bool littleEndian;
+    std::string name;
+    std::string vendor;
+    std::string driverVersion;
+    cl_uint addressBits;
+    size_t maxWorkGroupSize;
+
+    DeviceInfo() : id(0), littleEndian(true), addressBits(0), maxWorkGroupSize(0) { }
+};
+
 // Information about where in the host code the "something" was created
 struct HostAPICallInfo
 {
@@ -46,70 +201,444 @@ struct HostAPICallInfo
     }
 };
 
+typedef std::vector<std::string> ProgramSources;
+
 struct ProgramInfo : public HostAPICallInfo
 {
-    std::vector<std::string> sources;
+    // These never change once the program is created so they are shared
+    // with the invocation records rather than copied for each one.
+    std::shared_ptr<const ProgramSources> sources;
+    // Hash of the concatenated sources, computed when the program is created
+    Hash128 sourcesHash;
     std::string compileFlags;
 };
 
+// The value last passed to clSetKernelArg() for an argument. Values that
+// fit in InlineSize bytes (cl_mem handles and most scalars) are copied into
+// the ArgInfo itself, bigger ones (e.g. structs) into the kernel's argArena.
 struct ArgInfo
 {
-    const void* argValue;
+    static const size_t InlineSize = 32;
+
+    // How the kernel declares the argument. Implementations only tell us
+    // (through clGetKernelArgInfo()) if the program was built with
+    // -cl-kernel-arg-info. Otherwise it is UNKNOWN and we guess from the
+    // value it is given.
+    enum Declaration
+    {
+        UNKNOWN,
+        BUFFER,  // A __global or __constant pointer
+        LOCAL,   // A __local pointer
+        IMAGE,
+        SAMPLER,
+        VALUE    // Anything else, passed by value
+    };
+    Declaration declaration;
+
+    // False if NULL was passed as the value (e.g. for __local memory)
+    bool hasValue;
     size_t argSize;
-    ArgInfo() : argValue(0), argSize(0) { }
+    union
+    {
+        unsigned char inlineValue[InlineSize];
+        // So handles can be read straight out of inlineValue
+        uint64_t alignment;
+    };
+    // The space reserved for this argument in the kernel's argArena
+    size_t arenaOffset;
+    size_t arenaCapacity;
+    // False if the declaration says the kernel can't write the argument
+    // (e.g. a pointer to const or __constant)
+    bool kernelMayWrite;
+    // If the value was the handle of a memory object or sampler we know
+    // about when it was set, the generation it was registered under.
+    // Otherwise 0. Handles get reused so the value alone isn't enough to
+    // tell whether it still refers to the same object.
+    uint64_t generation;
+
+    ArgInfo() : declaration(UNKNOWN), hasValue(false), argSize(0), arenaOffset(0),
+                arenaCapacity(0), kernelMayWrite(true), generation(0) { }
 };
 
 struct KernelInfo : public HostAPICallInfo
 {
-    cl_program program;
+    // A copy of the program's information. A program can't be rebuilt
+    // once it has kernels so this never goes stale, and the program
+    // can be evicted while its kernels are still in use.
+    ProgramInfo program;
     std::string entryPointName;
     std::vector<ArgInfo> arguments;
-    size_t dimensions;
+    // Values of arguments too big to store inline. This is indexed by
+    // offset rather than pointer so KernelInfo can be copied.
+    std::vector<unsigned char> argArena;
+    bool loggedAlready;
+    // Shared by every kernel with the same entry point
+    Sampler::EntryPoint* sampling;
+    // See CaptureFilter::matchKernel()
+    uint64_t filterMatches;
+
+    // Copy ``value`` (which may be NULL) as the value of argument ``index``.
+    // ``generation`` is as described for ArgInfo::generation. This only
+    // allocates when a big argument grows beyond the space previously
+    // reserved for it.
+    void setArgument(unsigned index, size_t size, const void* value, uint64_t generation);
+
+    // The value last set for argument ``index``. NULL if NULL was set.
+    const void* argumentValue(unsigned index) const
+    {
+        const ArgInfo& ai = arguments[index];
+        if (!ai.hasValue)
+            return NULL;
+
+        if (ai.argSize <= ArgInfo::InlineSize)
+            return ai.inlineValue;
+
+        return &argArena[ai.arenaOffset];
+    }
+};
+
+// How a kernel argument is written to the log. This is worked out when
+// the kernel is enqueued because the objects it refers to might have
+// been released by the time the log is written.
+struct ArgRecord
+{
+    enum Kind
+    {
+        UNALLOCATED, // NULL was passed to clSetKernelArg()
+        ARRAY,
+        IMAGE,
+        SAMPLER,
+        SCALAR
+    };
+    Kind kind;
+    // How the kernel declares the argument, if we know
+    ArgInfo::Declaration declaration;
+    // The argument's size, or the buffer's size for arrays
+    size_t size;
+    cl_mem_flags flags;
+    // The bytes of a scalar
+    std::vector<unsigned char> value;
+    // Contents of an array, NULL if it wasn't read. Arguments
+    // passed the same buffer share a snapshot.
+    std::shared_ptr<BufferSnapshot> snapshot;
+
+    ArgRecord() : kind(SCALAR), declaration(ArgInfo::UNKNOWN), size(0), flags(0) { }
+};
+
+// Everything needed to write a log entry for one kernel invocation.
+// It is a copy so the application can carry on changing or releasing
+// its objects while the record waits to be written.
+struct InvocationRecord
+{
+    ProgramInfo program;
+    HostAPICallInfo kernelCall;
+    std::string entryPointName;
+    // NULL if the device could not be determined
+    const DeviceInfo* device;
     std::vector<size_t> globalWorkOffset;
     std::vector<size_t> globalWorkSize;
     std::vector<size_t> localWorkSize;
     bool localWorkSizeIsUnconstrained;
-    bool loggedAlready;
+    std::vector<ArgRecord> arguments;
+    // Set for launches held in a reservoir (see Sampler::hold()). The
+    // writer puts their JSON here rather than in the log.
+    std::shared_ptr<std::string> heldJSON;
+
+    InvocationRecord() : device(NULL), localWorkSizeIsUnconstrained(false) { }
+
+    // Each snapshot once, in argument order
+    std::vector<BufferSnapshot*> snapshots() const;
+
+    private:
+    InvocationRecord(const InvocationRecord&); /* = delete; */
+    InvocationRecord& operator=(const InvocationRecord&); /* = delete; */
 };
 
-struct ProgramInfoCacheCompare
+// A kernel source file we have already written
+struct WrittenKernelFile
 {
-      bool operator() (const ProgramInfo& lhs, const ProgramInfo& rhs) const;
+    std::shared_ptr<const ProgramSources> sources;
+    std::string fileName;
 };
 
-typedef std::map<ProgramInfo, std::string, ProgramInfoCacheCompare> ProgCacheMapTy;
+// Written kernel files keyed by the hash of their contents. Different
+// sources with the same hash share a bucket.
+typedef std::map<Hash128, std::vector<WrittenKernelFile> > ProgCacheMapTy;
 class Logger
 {
     public:
-        std::map<cl_mem, BufferInfo> buffers;
-        std::map<cl_mem, ImageInfo> images;
-        std::map<cl_sampler, SamplerInfo> samplers;
-        std::map<cl_program, ProgramInfo> programs;
-        std::map<cl_kernel, KernelInfo> kernels;
+        // These are accessed concurrently by the intercepted
+        // functions so they must be thread safe.
+        HandleRegistry<cl_mem, BufferInfo> buffers;
+        HandleRegistry<cl_mem, ImageInfo> images;
+        HandleRegistry<cl_sampler, SamplerInfo> samplers;
+        HandleRegistry<cl_program, ProgramInfo> programs;
+        HandleRegistry<cl_kernel, KernelInfo> kernels;
+        HandleRegistry<cl_device_id, DeviceInfo> devices;
         std::string directory;
+
+        // Must be held while building and submitting
+        // invocation records
+        std::mutex logLock;
         void openLog();
         void closeLog();
 
+        // If set buffer snapshots are taken without blocking the calling
+        // thread and the writer thread waits for the reads to complete.
+        bool asyncSnapshots;
+
+        // Snapshots of at least this many bytes are read straight into a
+        // mapped file in the logging directory rather than into memory that
+        // then has to be copied to the file. 0 if disabled or unsupported.
+        size_t mappedSnapshotSize;
+
+        // See pendStream()
+        size_t snapshotChunkSize;
+
+        // If set buffers are copied on the device when a kernel is
+        // enqueued and read back to the host by the writer thread
+        bool shadowSnapshots;
+        unsigned shadowedSnapshots;
+        unsigned shadowFallbacks;
+
+        // What to do with a new invocation record when the writer
+        // thread has fallen behind
+        enum WriterFullPolicy
+        {
+            BLOCK,       // Wait for the writer to catch up
+            DROP_DATA,   // Log the invocation without buffer snapshots
+            DROP_RECORD  // Don't log the invocation
+        };
+        WriterFullPolicy writerFullPolicy;
+
         Logger();
         ~Logger();
-        void dump(cl_kernel k);
-        BufferInfo * tryGetBuffer(ArgInfo &ai);
+
+        // Build a record of ``kernel`` being enqueued on ``queue``. If
+        // ``takeSnapshots`` is set the buffers the kernel might read are
+        // copied after the events in ``waitList``.
+        InvocationRecord* recordInvocation(cl_command_queue queue,
+                                           cl_kernel kernel,
+                                           cl_uint workDim,
+                                           const size_t* globalWorkOffset,
+                                           const size_t* globalWorkSize,
+                                           const size_t* localWorkSize,
+                                           cl_uint numEvents,
+                                           const cl_event* waitList,
+                                           bool takeSnapshots);
+
+        bool writerIsFull() const { return pendingRecords.full(); }
+
+        // Hand ``record`` to the writer thread which takes ownership of it.
+        // This waits if the writer is full unless ``force`` is set.
+        void submit(InvocationRecord* record, bool force=false);
+
+        // Counts of invocations that were logged incompletely or
+        // not at all because the writer was full
+        unsigned recordsWithoutData;
+        unsigned droppedRecords;
+
+        // Host memory held by buffer snapshots (that aren't in mapped
+        // files) from when they are taken until they are written, and by
+        // snapshotPool for reuse. Once this runs out snapshots are spilled
+        // to mapped files or, where that isn't possible, not taken at all.
+        MemoryBudget snapshotMemory;
+        SnapshotPool snapshotPool;
+        std::atomic<unsigned> spilledSnapshots;
+        // Buffers are logged without data when this happens
+        std::atomic<unsigned> snapshotsOverBudget;
+
+        // Nothing is logged while disarmed (see GVKI_DISARMED)
+        Arming arming;
+        // Whether a launch can be logged now, disarming if the armed
+        // window has closed. Must be called with logLock held.
+        bool armedLaunch();
+
+        // Which kernel launches are logged. Launches that don't match
+        // ``filter`` (see GVKI_FILTER) are dropped before sampling.
+        CaptureFilter filter;
+        Sampler sampler;
+        unsigned filteredLaunches;
+
+        // Count a launch of ``ki`` and return whether it matches the
+        // filter. Must be called with logLock held.
+        bool filterLaunch(KernelInfo& ki, cl_uint workDim, const size_t* globalWorkSize,
+                          const size_t* localWorkSize);
+        // The total size of the buffers set as ``ki``'s arguments
+        uint64_t bufferBytes(const KernelInfo& ki);
+
+        // Device memory held by shadow copies of buffers (see
+        // shadowSnapshot()). Once it runs out buffers are read
+        // straight back to the host as usual.
+        MemoryBudget shadowMemory;
+
+        // If a value passed to clSetKernelArg() for an argument declared
+        // as ``declaration`` is the handle of a memory object or sampler
+        // we know about return the generation it is registered under,
+        // otherwise 0.
+        uint64_t objectGeneration(ArgInfo::Declaration declaration, const void* argValue, size_t argSize);
+
+        // Snapshots of a buffer are reused until a command that might
+        // change its contents is enqueued. Enqueueing such a command (e.g.
+        // clEnqueueWriteBuffer()) must be bracketed by these so a snapshot
+        // another thread takes meanwhile isn't reused either. ``bufferId``
+        // is the buffer's generation in ``buffers``, 0 is ignored.
+        // ``queue`` is where the command is enqueued, NULL if unknown.
+        void beginBufferWrite(uint64_t bufferId, cl_command_queue queue);
+        void endBufferWrite(uint64_t bufferId);
+
+        // Add the ids (as for beginBufferWrite()) of the buffers that
+        // enqueueing ``ki`` with its current arguments might write to.
+        void kernelWrites(const KernelInfo& ki, std::vector<uint64_t>& bufferIds);
+
+        // Use a copy of ``hostPtr`` as the snapshot of a buffer that was just
+        // created from it with CL_MEM_COPY_HOST_PTR so the buffer doesn't have
+        // to be read back unless it has been written to since.
+        void captureHostContents(cl_mem memObject, const void* hostPtr, size_t size);
+
+        // Never reuse snapshots of a buffer, e.g. because it
+        // can be changed through an image created from it
+        void untrackBuffer(uint64_t bufferId);
+
+        // Forget the history of a buffer that is being evicted
+        void forgetBuffer(cl_mem memObject);
+        // Stop reusing every snapshot because writes enqueued while
+        // disarmed weren't seen
+        void forgetSnapshots();
+
+        // Arrange for ``memObject``'s entry in ``buffers`` or ``images``
+        // to be evicted when the implementation destroys it. Returns false
+        // if that isn't possible (e.g. OpenCL 1.0).
+        bool evictOnDestruction(cl_mem memObject);
 
         static Logger& Singleton();
+        // False before the Logger is created and once it starts being
+        // destroyed. The application can release objects from its own
+        // static destructors, so hooks that only release check this
+        // before calling Singleton().
+        static bool alive();
     private:
         // FIXME: Use std::unique_ptr<> instead
-        std::ofstream* output;
-        unsigned arrayDataCounter;
+        JSONWriter* output;
+        // Whether nothing has been written to the log's array yet
+        bool firstRecord;
         Logger(const Logger& that); /* = delete; */
         void initDirectoryNumbered();
         void initDirectoryManual(const char* rootDir);
+        void initWriterConfig();
+        void initSampling();
+        void initFilter();
+        void initArming();
+
+        // Copy the contents of ``memObject`` to the host after the events in
+        // ``waitList``. If asyncSnapshots is set this only enqueues the read,
+        // unless the buffer is big enough to be streamed. Returns NULL if
+        // the read could not be enqueued or there was no memory for it.
+        std::shared_ptr<BufferSnapshot> takeSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                     cl_uint numEvents, const cl_event* waitList);
+        // Read ``memObject`` into a new snapshot, or only enqueue
+        // the read if ``blocking`` isn't set (see takeSnapshot())
+        std::shared_ptr<BufferSnapshot> readSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                     bool blocking, cl_uint numEvents, const cl_event* waitList);
+        // Copy ``memObject`` to a new buffer on the device without waiting.
+        // This keeps the transfer to the host off the application's queue.
+        // Returns NULL if there isn't room for the copy in shadowMemory or
+        // on the device.
+        std::shared_ptr<BufferSnapshot> shadowSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                       cl_uint numEvents, const cl_event* waitList);
+        // Read the shadow copy of ``snapshot`` back to the host. Returns
+        // false on failure. Only called by the writer thread.
+        bool drainShadow(BufferSnapshot& snapshot);
+        // Our own queues that shadow copies are read back on, one per
+        // context and device. Only used by the writer thread, which
+        // releases them whenever it catches up so they don't keep
+        // contexts the application has released alive.
+        typedef std::map<std::pair<cl_context, cl_device_id>, cl_command_queue> DrainQueueMap;
+        DrainQueueMap drainQueues;
+        cl_command_queue drainQueue(cl_context context, cl_device_id device);
+        void releaseDrainQueues();
+        // Snapshot of ``memObject`` copied from ``hostPtr`` rather than read
+        // from the device
+        std::shared_ptr<BufferSnapshot> copySnapshot(cl_mem memObject, const void* hostPtr, size_t size);
+
+        // Snapshots bigger than snapshotChunkSize are streamed to a temporary
+        // file a chunk at a time rather than held in memory. This only
+        // enqueues a marker after ``waitList`` and returns a snapshot whose
+        // readEvent the kernel must wait for. ``chunks`` are two blocks of
+        // snapshotChunkSize bytes from snapshotPool, which the snapshot
+        // gives back.
+        std::shared_ptr<BufferSnapshot> pendStream(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                   char* chunks[2], cl_uint numEvents, const cl_event* waitList);
+        // Stream a snapshot from pendStream() on the writer thread, reading
+        // the next chunk while the last is written. Returns false on failure.
+        bool streamSnapshot(BufferSnapshot& snapshot);
+        std::shared_ptr<BufferSnapshot> streamHostSnapshot(cl_mem memObject, const void* hostPtr, size_t size);
+        // A name for a file in the logging directory that holds
+        // a snapshot until its contents are known
+        std::string newTemporaryFile();
+
+        // Keyed by buffer id (see beginBufferWrite())
+        std::mutex bufferHistoryLock;
+        std::unordered_map<uint64_t, BufferHistory> bufferHistory;
+        unsigned reusedSnapshots;
+        // Snapshots copied from host memory. Buffers are created without
+        // holding logLock so this is counted atomically.
+        std::atomic<unsigned> hostSnapshots;
+        std::atomic<unsigned> mappedSnapshots;
+        std::atomic<unsigned> streamedSnapshots;
+        std::atomic<unsigned> temporaryFiles;
+
+        // Memory for a snapshot of ``size`` bytes of ``memObject``. NULL
+        // if there is none left in snapshotMemory and none can be mapped.
+        std::shared_ptr<BufferSnapshot> newSnapshot(cl_mem memObject, size_t size);
+        std::shared_ptr<BufferSnapshot> mapSnapshot(cl_mem memObject, size_t size);
+
+        // Returns the snapshot of the buffer if it hasn't changed since it
+        // was taken. Otherwise returns NULL and sets ``writes`` for
+        // rememberSnapshot().
+        std::shared_ptr<BufferSnapshot> cleanSnapshot(uint64_t bufferId, uint64_t& writes);
+        // Keep ``snapshot`` (read through ``queue``) for reuse unless the
+        // buffer might have been written since cleanSnapshot() set ``writes``
+        // or the read might not have come after the last write.
+        void rememberSnapshot(uint64_t bufferId, uint64_t writes, cl_command_queue queue,
+                              const std::shared_ptr<BufferSnapshot>& snapshot);
+
+        // If argument ``ai`` still refers to the buffer it did when it was
+        // set copy that buffer's information to ``bi``.
+        bool tryGetBuffer(const ArgInfo& ai, const void* argValue, BufferInfo& bi);
+        void recordArgument(const ArgInfo& ai, const void* argValue, ArgRecord& ar);
+
+        // Returns the properties of the device ``queue`` is for, querying
+        // them if this is the first time we've seen it. Must be called with
+        // logLock held.
+        const DeviceInfo* getDevice(cl_command_queue queue);
+        // In the order they were first used
+        std::vector<cl_device_id> deviceTable;
+        void writeDeviceTable();
+
+        // Everything below here is only used by the writer thread
+        BoundedQueue<InvocationRecord*> pendingRecords;
+        std::thread writerThread;
+        void writeRecords();
+        void write(InvocationRecord& record);
+        // Returns false, having reported why, if it couldn't be written
+        bool writeSnapshot(BufferSnapshot& snapshot);
+        void dump(InvocationRecord& record);
+        // Start another element of the log's array
+        void separateRecord();
 
         void printJSONArray(std::vector<size_t>& array);
-        void printJSONKernelArgumentInfo(ArgInfo& ai);
+        void printJSONKernelArgumentInfo(ArgRecord& ar);
         void printJSONHostCodeInvocationInfo(HostAPICallInfo& info);
-        std::string dumpKernelSource(KernelInfo& ki);
+        std::string dumpKernelSource(InvocationRecord& record);
 
         ProgCacheMapTy WrittenKernelFileCache;
+        // The number to use in the next <entry_point>.<N>.cl file
+        std::map<std::string, unsigned> nextKernelFileNumber;
+
+        // Contents of the snapshots successfully written so far
+        std::set<Hash128> writtenSnapshots;
+        unsigned duplicateSnapshots;
 };
 
 }
@@ -0,0 +1,54 @@
+#ifndef GVKI_MEMORY_BUDGET_H
+#define GVKI_MEMORY_BUDGET_H
+#include <atomic>
+#include <cstddef>
+
+namespace gvki
+{
+
+// Counts memory shared by several threads against a limit. Memory is
+// reserved before it is allocated so the limit is never exceeded.
+class MemoryBudget
+{
+    public:
+        explicit MemoryBudget(size_t limit) : limit(limit), used(0), peak(0) { }
+
+        // Returns false, reserving nothing, if ``size`` more
+        // bytes would take the memory in use over the limit
+        bool reserve(size_t size)
+        {
+            size_t current = used.load(std::memory_order_relaxed);
+            do
+            {
+                if (size > limit - current)
+                    return false;
+            } while (!used.compare_exchange_weak(current, current + size, std::memory_order_relaxed));
+
+            size_t highest = peak.load(std::memory_order_relaxed);
+            while (current + size > highest &&
+                   !peak.compare_exchange_weak(highest, current + size, std::memory_order_relaxed))
+                ;
+            return true;
+        }
+
+        void release(size_t size)
+        {
+            used.fetch_sub(size, std::memory_order_relaxed);
+        }
+
+        size_t getLimit() const { return limit; }
+        size_t inUse() const { return used.load(std::memory_order_relaxed); }
+        // The most that has been in use at once
+        size_t peakUse() const { return peak.load(std::memory_order_relaxed); }
+
+    private:
+        const size_t limit;
+        std::atomic<size_t> used;
+        std::atomic<size_t> peak;
+
+        MemoryBudget(const MemoryBudget&); /* = delete; */
+        MemoryBudget& operator=(const MemoryBudget&); /* = delete; */
+};
+
+}
+#endif
@@ -0,0 +1,117 @@
+#ifndef GVKI_SAMPLER_H
+#define GVKI_SAMPLER_H
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace gvki
+{
+
+struct InvocationRecord;
+struct KernelInfo;
+
+// Decides which kernel launches are logged. It is configured with a
+// comma separated list of terms (see the README for GVKI_SAMPLE) which
+// are applied left to right; a term only sees the launches that the
+// terms before it let through. Deciding is O(1) in the number of
+// launches so it can be done before any work is spent on a launch.
+class Sampler
+{
+    public:
+        enum Decision
+        {
+            // Don't log the launch
+            SKIP,
+            // Log the launch now
+            CAPTURE,
+            // Log the launch into a reservoir slot (see hold())
+            HOLD
+        };
+
+        // Per entry point state of the terms. Kernels with the same entry
+        // point share one of these for as long as the Sampler lives.
+        struct EntryPoint
+        {
+            // Launches each term has seen
+            std::vector<uint64_t> launches;
+            // The JSON of the launches held by a reservoir term, filled in
+            // by the Logger's writer. NULL where a slot is empty.
+            std::vector<std::shared_ptr<std::string> > reservoir;
+            // Every launch, including those filtered out before sampling
+            uint64_t launched;
+
+            EntryPoint() : launched(0) { }
+        };
+
+        Sampler();
+
+        // Parse ``spec``. Returns false, leaving the terms
+        // as they were, if it is malformed.
+        bool configure(const std::string& spec);
+        void seed(uint64_t value) { random.seed(value); }
+
+        // State for kernels of ``entryPointName``. Safe
+        // to call from several threads at once.
+        EntryPoint* entryPoint(const std::string& entryPointName);
+
+        // Whether to log a launch of ``ki``. For HOLD ``slot`` is set to
+        // the reservoir slot to pass to hold(). Must be called with the
+        // Logger's logLock held.
+        Decision decide(KernelInfo& ki, unsigned& slot);
+        // Keep ``record``'s JSON in reservoir ``slot`` for ``ki``'s entry
+        // point until the end, replacing what was there. The record is
+        // still written by the Logger, which puts its JSON in
+        // ``record->heldJSON`` rather than the log. Must be called with
+        // the Logger's logLock held.
+        void hold(KernelInfo& ki, unsigned slot, InvocationRecord* record);
+        // Hand over the JSON still held, emptying the reservoirs
+        std::vector<std::shared_ptr<std::string> > takeHeldRecords();
+
+        unsigned skipped() const { return skippedLaunches; }
+
+    private:
+        struct Term
+        {
+            enum Kind
+            {
+                // Only the first logged launch of each kernel object
+                ONCE,
+                ALL,
+                // The first launch and every ``count``th after it
+                EVERY,
+                // The first ``count`` launches
+                FIRST,
+                // Each launch with ``probability``
+                PROBABILITY,
+                // ``count`` launches uniformly chosen from all of them
+                RESERVOIR,
+                // At most ``count`` launches of any kernel per ``window``
+                RATE
+            };
+            Kind kind;
+            uint64_t count;
+            double probability;
+            std::chrono::steady_clock::duration window;
+            // For RATE, which is shared by all entry points
+            std::chrono::steady_clock::time_point windowStart;
+            uint64_t windowLaunches;
+        };
+        std::vector<Term> terms;
+        std::mt19937_64 random;
+        unsigned skippedLaunches;
+
+        // Only guards adding entry points. Their state is guarded by logLock.
+        std::mutex entryPointsLock;
+        std::unordered_map<std::string, EntryPoint> entryPoints;
+
+        Sampler(const Sampler&); /* = delete; */
+        Sampler& operator=(const Sampler&); /* = delete; */
+};
+
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef GVKI_SNAPSHOT_POOL_H
+#define GVKI_SNAPSHOT_POOL_H
+#include "gvki/MemoryBudget.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace gvki
+{
+
+// Host memory that buffers are read back into. Blocks are kept for reuse
+// once a snapshot has been written so an application launching the same
+// kernels over and over doesn't cause an allocation per snapshot. Blocks
+// come in size classes (powers of two and halfway between them) and are
+// reserved in the budget for as long as the pool holds them, in use or
+// not.
+class SnapshotPool
+{
+    public:
+        explicit SnapshotPool(MemoryBudget& budget);
+        ~SnapshotPool();
+
+        // A block of at least ``size`` bytes. Returns NULL if there is no
+        // room in the budget, even once every unused block has been freed.
+        char* allocate(size_t size);
+        // Take back a block that allocate(``size``) returned
+        void release(char* block, size_t size);
+
+        unsigned allocations() const { return allocated; }
+        unsigned reuses() const { return reused; }
+
+    private:
+        MemoryBudget& budget;
+        std::mutex lock;
+        // Unused blocks indexed by size class
+        std::vector<std::vector<char*> > unused;
+        std::atomic<unsigned> allocated;
+        std::atomic<unsigned> reused;
+
+        void freeUnused();
+
+        SnapshotPool(const SnapshotPool&); /* = delete; */
+        SnapshotPool& operator=(const SnapshotPool&); /* = delete; */
+};
+
+}
+#endif
@@ -125,6 +125,39 @@ class UnderlyingCaller
                                                 size_t *);
         clGetKernelInfoTy clGetKernelInfoU;
 
+#ifdef CL_VERSION_1_2
+        typedef cl_int (CL_CALLBACK *clGetKernelArgInfoTy)(cl_kernel,
+                                                           cl_uint,
+                                                           cl_kernel_arg_info,
+                                                           size_t,
+                                                           void *,
+                                                           size_t *);
+        clGetKernelArgInfoTy clGetKernelArgInfoU;
+#endif
+
+        typedef cl_int (CL_CALLBACK *clGetCommandQueueInfoTy)(cl_command_queue,
+                                                              cl_command_queue_info,
+                                                              size_t,
+                                                              void *,
+                                                              size_t *);
+        clGetCommandQueueInfoTy clGetCommandQueueInfoU;
+
+        typedef cl_command_queue (CL_CALLBACK *clCreateCommandQueueTy)(cl_context,
+                                                                       cl_device_id,
+                                                                       cl_command_queue_properties,
+                                                                       cl_int *);
+        clCreateCommandQueueTy clCreateCommandQueueU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseCommandQueueTy)(cl_command_queue);
+        clReleaseCommandQueueTy clReleaseCommandQueueU;
+
+        typedef cl_int (CL_CALLBACK *clGetDeviceInfoTy)(cl_device_id,
+                                                        cl_device_info,
+                                                        size_t,
+                                                        void *,
+                                                        size_t *);
+        clGetDeviceInfoTy clGetDeviceInfoU;
+
         typedef cl_int (CL_CALLBACK *clEnqueueReadBufferTy)(cl_command_queue,
           cl_mem,
           cl_bool,
@@ -137,6 +170,189 @@ class UnderlyingCaller
 
         clEnqueueReadBufferTy clEnqueueReadBufferU;
 
+        typedef cl_int (CL_CALLBACK *clRetainEventTy)(cl_event);
+        clRetainEventTy clRetainEventU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseEventTy)(cl_event);
+        clReleaseEventTy clReleaseEventU;
+
+        typedef cl_int (CL_CALLBACK *clWaitForEventsTy)(cl_uint, const cl_event*);
+        clWaitForEventsTy clWaitForEventsU;
+
+        typedef cl_int (CL_CALLBACK *clFlushTy)(cl_command_queue);
+        clFlushTy clFlushU;
+
+        typedef cl_int (CL_CALLBACK *clRetainMemObjectTy)(cl_mem);
+        clRetainMemObjectTy clRetainMemObjectU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseMemObjectTy)(cl_mem);
+        clReleaseMemObjectTy clReleaseMemObjectU;
+
+#ifdef CL_VERSION_1_1
+        typedef cl_int (CL_CALLBACK *clSetMemObjectDestructorCallbackTy)(cl_mem,
+                                                                         void (CL_CALLBACK * /* pfn_notify */)(cl_mem /* memobj */, void* /* user_data */),
+                                                                         void*);
+        clSetMemObjectDestructorCallbackTy clSetMemObjectDestructorCallbackU;
+#endif
+
+        typedef cl_int (CL_CALLBACK *clRetainSamplerTy)(cl_sampler);
+        clRetainSamplerTy clRetainSamplerU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseSamplerTy)(cl_sampler);
+        clReleaseSamplerTy clReleaseSamplerU;
+
+        typedef cl_int (CL_CALLBACK *clRetainProgramTy)(cl_program);
+        clRetainProgramTy clRetainProgramU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseProgramTy)(cl_program);
+        clReleaseProgramTy clReleaseProgramU;
+
+        typedef cl_int (CL_CALLBACK *clRetainKernelTy)(cl_kernel);
+        clRetainKernelTy clRetainKernelU;
+
+        typedef cl_int (CL_CALLBACK *clReleaseKernelTy)(cl_kernel);
+        clReleaseKernelTy clReleaseKernelU;
+
+        // Commands that change the contents of buffers
+        typedef cl_int (CL_CALLBACK *clEnqueueWriteBufferTy)(cl_command_queue,
+                                                             cl_mem,
+                                                             cl_bool,
+                                                             size_t,
+                                                             size_t,
+                                                             const void *,
+                                                             cl_uint,
+                                                             const cl_event *,
+                                                             cl_event *);
+        clEnqueueWriteBufferTy clEnqueueWriteBufferU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueCopyBufferTy)(cl_command_queue,
+                                                            cl_mem,
+                                                            cl_mem,
+                                                            size_t,
+                                                            size_t,
+                                                            size_t,
+                                                            cl_uint,
+                                                            const cl_event *,
+                                                            cl_event *);
+        clEnqueueCopyBufferTy clEnqueueCopyBufferU;
+
+#ifdef CL_VERSION_1_1
+        typedef cl_int (CL_CALLBACK *clEnqueueWriteBufferRectTy)(cl_command_queue,
+                                                                 cl_mem,
+                                                                 cl_bool,
+                                                                 const size_t *,
+                                                                 const size_t *,
+                                                                 const size_t *,
+                                                                 size_t,
+                                                                 size_t,
+                                                                 size_t,
+                                                                 size_t,
+                                                                 const void *,
+                                                                 cl_uint,
+                                                                 const cl_event *,
+                                                                 cl_event *);
+        clEnqueueWriteBufferRectTy clEnqueueWriteBufferRectU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueCopyBufferRectTy)(cl_command_queue,
+                                                                cl_mem,
+                                                                cl_mem,
+                                                                const size_t *,
+                                                                const size_t *,
+                                                                const size_t *,
+                                                                size_t,
+                                                                size_t,
+                                                                size_t,
+                                                                size_t,
+                                                                cl_uint,
+                                                                const cl_event *,
+                                                                cl_event *);
+        clEnqueueCopyBufferRectTy clEnqueueCopyBufferRectU;
+#endif
+
+#ifdef CL_VERSION_1_2
+        typedef cl_int (CL_CALLBACK *clEnqueueFillBufferTy)(cl_command_queue,
+                                                            cl_mem,
+                                                            const void *,
+                                                            size_t,
+                                                            size_t,
+                                                            size_t,
+                                                            cl_uint,
+                                                            const cl_event *,
+                                                            cl_event *);
+        clEnqueueFillBufferTy clEnqueueFillBufferU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueMigrateMemObjectsTy)(cl_command_queue,
+                                                                   cl_uint,
+                                                                   const cl_mem *,
+                                                                   cl_mem_migration_flags,
+                                                                   cl_uint,
+                                                                   const cl_event *,
+                                                                   cl_event *);
+        clEnqueueMigrateMemObjectsTy clEnqueueMigrateMemObjectsU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueMarkerWithWaitListTy)(cl_command_queue,
+                                                                    cl_uint,
+                                                                    const cl_event *,
+                                                                    cl_event *);
+        clEnqueueMarkerWithWaitListTy clEnqueueMarkerWithWaitListU;
+
+        typedef cl_event (CL_CALLBACK *clCreateUserEventTy)(cl_context, cl_int *);
+        clCreateUserEventTy clCreateUserEventU;
+
+        typedef cl_int (CL_CALLBACK *clSetUserEventStatusTy)(cl_event, cl_int);
+        clSetUserEventStatusTy clSetUserEventStatusU;
+#endif
+
+        typedef cl_int (CL_CALLBACK *clEnqueueCopyImageToBufferTy)(cl_command_queue,
+                                                                   cl_mem,
+                                                                   cl_mem,
+                                                                   const size_t *,
+                                                                   const size_t *,
+                                                                   size_t,
+                                                                   cl_uint,
+                                                                   const cl_event *,
+                                                                   cl_event *);
+        clEnqueueCopyImageToBufferTy clEnqueueCopyImageToBufferU;
+
+        typedef void * (CL_CALLBACK *clEnqueueMapBufferTy)(cl_command_queue,
+                                                           cl_mem,
+                                                           cl_bool,
+                                                           cl_map_flags,
+                                                           size_t,
+                                                           size_t,
+                                                           cl_uint,
+                                                           const cl_event *,
+                                                           cl_event *,
+                                                           cl_int *);
+        clEnqueueMapBufferTy clEnqueueMapBufferU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueUnmapMemObjectTy)(cl_command_queue,
+                                                                cl_mem,
+                                                                void *,
+                                                                cl_uint,
+                                                                const cl_event *,
+                                                                cl_event *);
+        clEnqueueUnmapMemObjectTy clEnqueueUnmapMemObjectU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueTaskTy)(cl_command_queue,
+                                                      cl_kernel,
+                                                      cl_uint,
+                                                      const cl_event *,
+                                                      cl_event *);
+        clEnqueueTaskTy clEnqueueTaskU;
+
+        typedef cl_int (CL_CALLBACK *clEnqueueNativeKernelTy)(cl_command_queue,
+                                                              void (CL_CALLBACK * /* user_func */)(void *),
+                                                              void *,
+                                                              size_t,
+                                                              cl_uint,
+                                                              const cl_mem *,
+                                                              const void **,
+                                                              cl_uint,
+                                                              const cl_event *,
+                                                              cl_event *);
+        clEnqueueNativeKernelTy clEnqueueNativeKernelU;
+
         UnderlyingCaller();
 
         static UnderlyingCaller& Singleton();
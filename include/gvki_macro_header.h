@@ -116,6 +116,159 @@ clEnqueueNDRangeKernel_hook(cl_command_queue /* command_queue */,
                             cl_event *       /* event */);
 
 
+extern cl_int
+clRetainMemObject_hook(cl_mem /* memobj */);
+
+extern cl_int
+clReleaseMemObject_hook(cl_mem /* memobj */);
+
+extern cl_int
+clRetainSampler_hook(cl_sampler /* sampler */);
+
+extern cl_int
+clReleaseSampler_hook(cl_sampler /* sampler */);
+
+extern cl_int
+clRetainProgram_hook(cl_program /* program */);
+
+extern cl_int
+clReleaseProgram_hook(cl_program /* program */);
+
+extern cl_int
+clRetainKernel_hook(cl_kernel /* kernel */);
+
+extern cl_int
+clReleaseKernel_hook(cl_kernel /* kernel */);
+
+
+extern cl_int
+clEnqueueWriteBuffer_hook(cl_command_queue /* command_queue */,
+                          cl_mem           /* buffer */,
+                          cl_bool          /* blocking_write */,
+                          size_t           /* offset */,
+                          size_t           /* size */,
+                          const void *     /* ptr */,
+                          cl_uint          /* num_events_in_wait_list */,
+                          const cl_event * /* event_wait_list */,
+                          cl_event *       /* event */);
+
+extern cl_int
+clEnqueueCopyBuffer_hook(cl_command_queue /* command_queue */,
+                         cl_mem           /* src_buffer */,
+                         cl_mem           /* dst_buffer */,
+                         size_t           /* src_offset */,
+                         size_t           /* dst_offset */,
+                         size_t           /* size */,
+                         cl_uint          /* num_events_in_wait_list */,
+                         const cl_event * /* event_wait_list */,
+                         cl_event *       /* event */);
+
+#ifdef CL_VERSION_1_1
+extern cl_int
+clEnqueueWriteBufferRect_hook(cl_command_queue /* command_queue */,
+                              cl_mem           /* buffer */,
+                              cl_bool          /* blocking_write */,
+                              const size_t *   /* buffer_origin */,
+                              const size_t *   /* host_origin */,
+                              const size_t *   /* region */,
+                              size_t           /* buffer_row_pitch */,
+                              size_t           /* buffer_slice_pitch */,
+                              size_t           /* host_row_pitch */,
+                              size_t           /* host_slice_pitch */,
+                              const void *     /* ptr */,
+                              cl_uint          /* num_events_in_wait_list */,
+                              const cl_event * /* event_wait_list */,
+                              cl_event *       /* event */);
+
+extern cl_int
+clEnqueueCopyBufferRect_hook(cl_command_queue /* command_queue */,
+                             cl_mem           /* src_buffer */,
+                             cl_mem           /* dst_buffer */,
+                             const size_t *   /* src_origin */,
+                             const size_t *   /* dst_origin */,
+                             const size_t *   /* region */,
+                             size_t           /* src_row_pitch */,
+                             size_t           /* src_slice_pitch */,
+                             size_t           /* dst_row_pitch */,
+                             size_t           /* dst_slice_pitch */,
+                             cl_uint          /* num_events_in_wait_list */,
+                             const cl_event * /* event_wait_list */,
+                             cl_event *       /* event */);
+#endif
+
+#ifdef CL_VERSION_1_2
+extern cl_int
+clEnqueueFillBuffer_hook(cl_command_queue /* command_queue */,
+                         cl_mem           /* buffer */,
+                         const void *     /* pattern */,
+                         size_t           /* pattern_size */,
+                         size_t           /* offset */,
+                         size_t           /* size */,
+                         cl_uint          /* num_events_in_wait_list */,
+                         const cl_event * /* event_wait_list */,
+                         cl_event *       /* event */);
+
+extern cl_int
+clEnqueueMigrateMemObjects_hook(cl_command_queue       /* command_queue */,
+                                cl_uint                /* num_mem_objects */,
+                                const cl_mem *         /* mem_objects */,
+                                cl_mem_migration_flags /* flags */,
+                                cl_uint                /* num_events_in_wait_list */,
+                                const cl_event *       /* event_wait_list */,
+                                cl_event *             /* event */);
+#endif
+
+extern cl_int
+clEnqueueCopyImageToBuffer_hook(cl_command_queue /* command_queue */,
+                                cl_mem           /* src_image */,
+                                cl_mem           /* dst_buffer */,
+                                const size_t *   /* src_origin */,
+                                const size_t *   /* region */,
+                                size_t           /* dst_offset */,
+                                cl_uint          /* num_events_in_wait_list */,
+                                const cl_event * /* event_wait_list */,
+                                cl_event *       /* event */);
+
+extern void *
+clEnqueueMapBuffer_hook(cl_command_queue /* command_queue */,
+                        cl_mem           /* buffer */,
+                        cl_bool          /* blocking_map */,
+                        cl_map_flags     /* map_flags */,
+                        size_t           /* offset */,
+                        size_t           /* size */,
+                        cl_uint          /* num_events_in_wait_list */,
+                        const cl_event * /* event_wait_list */,
+                        cl_event *       /* event */,
+                        cl_int *         /* errcode_ret */);
+
+extern cl_int
+clEnqueueUnmapMemObject_hook(cl_command_queue /* command_queue */,
+                             cl_mem           /* memobj */,
+                             void *           /* mapped_ptr */,
+                             cl_uint          /* num_events_in_wait_list */,
+                             const cl_event * /* event_wait_list */,
+                             cl_event *       /* event */);
+
+extern cl_int
+clEnqueueTask_hook(cl_command_queue /* command_queue */,
+                   cl_kernel        /* kernel */,
+                   cl_uint          /* num_events_in_wait_list */,
+                   const cl_event * /* event_wait_list */,
+                   cl_event *       /* event */);
+
+extern cl_int
+clEnqueueNativeKernel_hook(cl_command_queue /* command_queue */,
+                           void (CL_CALLBACK * /* user_func */)(void *),
+                           void *           /* args */,
+                           size_t           /* cb_args */,
+                           cl_uint          /* num_mem_objects */,
+                           const cl_mem *   /* mem_list */,
+                           const void **    /* args_mem_loc */,
+                           cl_uint          /* num_events_in_wait_list */,
+                           const cl_event * /* event_wait_list */,
+                           cl_event *       /* event */);
+
+
 /* Use macros to rewrite host code to use our hooks.
  *
  * */
@@ -130,9 +283,31 @@ clEnqueueNDRangeKernel_hook(cl_command_queue /* command_queue */,
 #define clCreateKernelsInProgram clCreateKernelsInProgram_hook
 #define clSetKernelArg clSetKernelArg_hook
 #define clEnqueueNDRangeKernel clEnqueueNDRangeKernel_hook
+#define clRetainMemObject clRetainMemObject_hook
+#define clReleaseMemObject clReleaseMemObject_hook
+#define clRetainSampler clRetainSampler_hook
+#define clReleaseSampler clReleaseSampler_hook
+#define clRetainProgram clRetainProgram_hook
+#define clReleaseProgram clReleaseProgram_hook
+#define clRetainKernel clRetainKernel_hook
+#define clReleaseKernel clReleaseKernel_hook
+#define clEnqueueWriteBuffer clEnqueueWriteBuffer_hook
+#define clEnqueueCopyBuffer clEnqueueCopyBuffer_hook
+#define clEnqueueCopyImageToBuffer clEnqueueCopyImageToBuffer_hook
+#define clEnqueueMapBuffer clEnqueueMapBuffer_hook
+#define clEnqueueUnmapMemObject clEnqueueUnmapMemObject_hook
+#define clEnqueueTask clEnqueueTask_hook
+#define clEnqueueNativeKernel clEnqueueNativeKernel_hook
+
+#ifdef CL_VERSION_1_1
+#define clEnqueueWriteBufferRect clEnqueueWriteBufferRect_hook
+#define clEnqueueCopyBufferRect clEnqueueCopyBufferRect_hook
+#endif
 
 #ifdef CL_VERSION_1_2
 #define clCreateImage clCreateImage_hook
+#define clEnqueueFillBuffer clEnqueueFillBuffer_hook
+#define clEnqueueMigrateMemObjects clEnqueueMigrateMemObjects_hook
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,235 @@
+#include "gvki/Arming.h"
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace gvki;
+
+// What the signal handler arms. Only one Arming (the Logger's) exists.
+static std::atomic<Arming*> signalTarget(NULL);
+
+// The application's handler for the signal, which is still called
+#ifdef _WIN32
+static void (*previousHandler)(int) = SIG_DFL;
+
+static void armOnSignalHandler(int signal)
+{
+    Arming* target = signalTarget.load();
+    if (target != NULL)
+        target->arm();
+
+    if (previousHandler != SIG_DFL && previousHandler != SIG_IGN)
+        previousHandler(signal);
+}
+#else
+static struct sigaction previousAction;
+
+static void armOnSignalHandler(int signal, siginfo_t* info, void* context)
+{
+    Arming* target = signalTarget.load();
+    if (target != NULL)
+        target->arm();
+
+    // The default action for the arming signal is to exit, so only a
+    // handler the application installed is called
+    if (previousAction.sa_flags & SA_SIGINFO)
+        previousAction.sa_sigaction(signal, info, context);
+    else if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN)
+        previousAction.sa_handler(signal);
+}
+#endif
+
+Arming::Arming() : armedFlag(true), armRequested(false), disarmable(false), launchLimit(0), window(0),
+                   launchesLeft(0), armings(0), armingSignal(0), inotifyFd(-1)
+{
+    stopPipe[0] = stopPipe[1] = -1;
+}
+
+Arming::~Arming()
+{
+    Arming* self = this;
+    if (signalTarget.compare_exchange_strong(self, NULL) && armingSignal != 0)
+    {
+        // Give the signal back to the application
+#ifdef _WIN32
+        ::signal(armingSignal, previousHandler);
+#else
+        sigaction(armingSignal, &previousAction, NULL);
+#endif
+    }
+
+#ifdef __linux__
+    if (watcher.joinable())
+    {
+        char wake = 0;
+        while (write(stopPipe[1], &wake, 1) < 0 && errno == EINTR)
+            ;
+        watcher.join();
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+    }
+
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+void Arming::configure(uint64_t launches, double seconds)
+{
+    launchLimit = launches;
+    window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    disarmable = true;
+    armedFlag = false;
+}
+
+void Arming::armOnSignal(int signal)
+{
+    signalTarget = this;
+    armingSignal = signal;
+
+#ifdef _WIN32
+    previousHandler = ::signal(signal, armOnSignalHandler);
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = armOnSignalHandler;
+    sigemptyset(&action.sa_mask);
+    // Don't make the application's system calls fail with EINTR. The
+    // siginfo is passed on to the application's handler.
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigaction(signal, &action, &previousAction);
+#endif
+}
+
+void Arming::arm()
+{
+    // Requested first so windowOpen() can't miss it (see there)
+    armRequested = true;
+    armedFlag = true;
+}
+
+bool Arming::windowOpen(bool& justArmed)
+{
+    justArmed = armRequested.exchange(false);
+    if (justArmed)
+    {
+        // Arming again while armed starts a new window
+        launchesLeft = launchLimit;
+        windowStart = std::chrono::steady_clock::now();
+        ++armings;
+    }
+
+    if (!disarmable)
+        return true;
+
+    bool open = armings > 0 && (launchLimit == 0 || launchesLeft > 0) &&
+                (window == std::chrono::steady_clock::duration::zero() ||
+                 std::chrono::steady_clock::now() - windowStart < window);
+    if (!open)
+    {
+        armedFlag = false;
+        // arm() might have been called since the exchange above
+        if (armRequested)
+            armedFlag = true;
+    }
+    return open;
+}
+
+void Arming::logged()
+{
+    if (launchesLeft > 0)
+        --launchesLeft;
+}
+
+#ifdef __linux__
+bool Arming::armOnTrigger(const std::string& path, std::string& error)
+{
+    // The directory is watched because the file needn't exist yet
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+    triggerName = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    if (triggerName.empty())
+    {
+        error = "\"" + path + "\" is a directory";
+        return false;
+    }
+
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (inotifyFd < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    // Writing the file (e.g. with touch) or renaming one over it
+    if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        error = "can't watch \"" + directory + "\": " + strerror(errno);
+        return false;
+    }
+
+    if (pipe2(stopPipe, O_CLOEXEC) != 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    watcher = std::thread(&Arming::watchTrigger, this);
+    return true;
+}
+
+void Arming::watchTrigger()
+{
+    // Events are variable length, ending in the file name
+    alignas(struct inotify_event) char events[4096];
+    struct pollfd fds[2];
+    fds[0].fd = inotifyFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stopPipe[0];
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        if (fds[1].revents != 0)
+            return;
+
+        ssize_t length = read(inotifyFd, events, sizeof(events));
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return;
+
+        bool triggered = false;
+        for (char* next = events; next < events + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*) next;
+            if (event->len > 0 && triggerName == event->name)
+                triggered = true;
+            next += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (triggered)
+            arm();
+    }
+}
+#else
+bool Arming::armOnTrigger(const std::string& path, std::string& error)
+{
+    error = "trigger files are only supported on Linux";
+    return false;
+}
+#endif
@@ -0,0 +1,440 @@
+#include "gvki/CaptureFilter.h"
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+using namespace gvki;
+
+// ``*`` matches any run of characters and ``?`` any one character
+static bool globMatch(const char* pattern, const char* text)
+{
+    // Where to resume if what follows the last ``*`` doesn't match
+    const char* starPattern = NULL;
+    const char* starText = NULL;
+    while (*text != '\0')
+    {
+        if (*pattern == '*')
+        {
+            starPattern = ++pattern;
+            starText = text;
+        }
+        else if (*pattern == '?' || *pattern == *text)
+        {
+            ++pattern;
+            ++text;
+        }
+        else if (starPattern != NULL)
+        {
+            pattern = starPattern;
+            text = ++starText;
+        }
+        else
+            return false;
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+    return *pattern == '\0';
+}
+
+namespace gvki
+{
+
+// Recursive descent over
+//
+//   or        := and ( "||" and )*
+//   and       := unary ( "&&" unary )*
+//   unary     := "!" unary | "(" or ")" | predicate
+//   predicate := "name" ( "==" | "!=" | "=~" ) STRING
+//              | "source" ( "==" | "!=" ) STRING
+//              | FIELD [ "[" DIGIT "]" ] ( "<" | "<=" | ">" | ">=" | "==" | "!=" ) NUMBER
+//
+// emitting instructions as it goes. ``#`` starts a comment.
+class FilterParser
+{
+    public:
+        FilterParser(const std::string& text, CaptureFilter& filter) : text(text), position(0), filter(filter) { }
+
+        bool parse(std::string& error)
+        {
+            if (parseOr())
+            {
+                skipSpace();
+                if (position == text.size())
+                    return true;
+                fail("unexpected \"" + text.substr(position, 1) + "\"");
+            }
+
+            std::stringstream ss;
+            ss << problem << " at offset " << position;
+            error = ss.str();
+            return false;
+        }
+
+    private:
+        typedef CaptureFilter::Instruction Instruction;
+
+        const std::string& text;
+        size_t position;
+        CaptureFilter& filter;
+        std::string problem;
+
+        bool fail(const std::string& message)
+        {
+            if (problem.empty())
+                problem = message;
+            return false;
+        }
+
+        void skipSpace()
+        {
+            while (position < text.size())
+            {
+                if (text[position] == '#')
+                {
+                    while (position < text.size() && text[position] != '\n')
+                        ++position;
+                }
+                else if (isspace((unsigned char) text[position]))
+                    ++position;
+                else
+                    break;
+            }
+        }
+
+        bool accept(const char* symbol)
+        {
+            skipSpace();
+            size_t length = strlen(symbol);
+            if (text.compare(position, length, symbol) != 0)
+                return false;
+            position += length;
+            return true;
+        }
+
+        unsigned emit(Instruction::Op op, unsigned operand = 0)
+        {
+            Instruction instruction;
+            instruction.op = op;
+            instruction.operand = operand;
+            instruction.field = CaptureFilter::WORK_DIM;
+            instruction.comparison = CaptureFilter::EQ;
+            instruction.value = 0;
+            filter.program.push_back(instruction);
+            return filter.program.size() - 1;
+        }
+
+        // Parse operands separated by ``separator``, jumping past the rest
+        // as soon as the result is known
+        bool parseChain(const char* separator, Instruction::Op jump, bool (FilterParser::*operand)())
+        {
+            if (!(this->*operand)())
+                return false;
+
+            std::vector<unsigned> jumps;
+            while (accept(separator))
+            {
+                jumps.push_back(emit(jump));
+                if (!(this->*operand)())
+                    return false;
+            }
+
+            for (unsigned index = 0; index < jumps.size(); ++index)
+                filter.program[jumps[index]].operand = filter.program.size();
+            return true;
+        }
+
+        bool parseOr() { return parseChain("||", Instruction::JUMP_IF_TRUE, &FilterParser::parseAnd); }
+        bool parseAnd() { return parseChain("&&", Instruction::JUMP_IF_FALSE, &FilterParser::parseUnary); }
+
+        bool parseUnary()
+        {
+            if (accept("!"))
+            {
+                if (!parseUnary())
+                    return false;
+                emit(Instruction::NOT);
+                return true;
+            }
+
+            if (accept("("))
+                return parseOr() && (accept(")") || fail("expected \")\""));
+
+            return parsePredicate();
+        }
+
+        bool parseComparison(CaptureFilter::Comparison& comparison)
+        {
+            // Longest first
+            if (accept("<="))
+                comparison = CaptureFilter::LE;
+            else if (accept(">="))
+                comparison = CaptureFilter::GE;
+            else if (accept("=="))
+                comparison = CaptureFilter::EQ;
+            else if (accept("!="))
+                comparison = CaptureFilter::NE;
+            else if (accept("<"))
+                comparison = CaptureFilter::LT;
+            else if (accept(">"))
+                comparison = CaptureFilter::GT;
+            else
+                return fail("expected a comparison");
+            return true;
+        }
+
+        bool parseString(std::string& value)
+        {
+            if (!accept("\""))
+                return fail("expected a quoted string");
+
+            value.clear();
+            for (; position < text.size() && text[position] != '"'; ++position)
+            {
+                if (text[position] == '\\' && position + 1 < text.size())
+                    ++position;
+                value += text[position];
+            }
+
+            if (position == text.size())
+                return fail("unterminated string");
+            ++position;
+            return true;
+        }
+
+        // A whole number, optionally followed by K, M or G (powers of 1024)
+        bool parseNumber(uint64_t& value)
+        {
+            skipSpace();
+            if (position == text.size() || !isdigit((unsigned char) text[position]))
+                return fail("expected a number");
+
+            value = 0;
+            for (; position < text.size() && isdigit((unsigned char) text[position]); ++position)
+                value = value * 10 + (text[position] - '0');
+
+            if (position < text.size())
+            {
+                const char* suffixes = "KMG";
+                const char* suffix = text[position] != '\0' ? strchr(suffixes, text[position]) : NULL;
+                if (suffix != NULL)
+                {
+                    value <<= 10 * (suffix - suffixes + 1);
+                    ++position;
+                }
+            }
+            return true;
+        }
+
+        bool parseKernelTest(const std::string& subject)
+        {
+            CaptureFilter::KernelTest test;
+            bool negate = false;
+            if (subject == "name" && accept("=~"))
+                test.kind = CaptureFilter::KernelTest::NAME_REGEX;
+            else if (accept("==") || (negate = accept("!=")))
+            {
+                test.kind = subject == "name" ? CaptureFilter::KernelTest::NAME_GLOB
+                                              : CaptureFilter::KernelTest::SOURCE_PREFIX;
+            }
+            else
+                return fail("expected \"==\" or \"!=\"");
+
+            if (!parseString(test.pattern))
+                return false;
+
+            if (test.kind == CaptureFilter::KernelTest::NAME_REGEX)
+            {
+                try
+                {
+                    test.regex = std::regex(test.pattern);
+                }
+                catch (const std::regex_error&)
+                {
+                    return fail("bad regular expression \"" + test.pattern + "\"");
+                }
+            }
+            else if (test.kind == CaptureFilter::KernelTest::SOURCE_PREFIX)
+            {
+                if (test.pattern.empty() || test.pattern.size() > 32 ||
+                    test.pattern.find_first_not_of("0123456789abcdef") != std::string::npos)
+                    return fail("expected the start of a sources hash in lower case hex");
+            }
+
+            // The results are passed around as a 64-bit mask
+            if (filter.kernelTests.size() == 64)
+                return fail("too many name and source tests");
+
+            filter.kernelTests.push_back(test);
+            emit(Instruction::TEST_KERNEL, filter.kernelTests.size() - 1);
+            if (negate)
+                emit(Instruction::NOT);
+            return true;
+        }
+
+        bool parsePredicate()
+        {
+            skipSpace();
+            size_t start = position;
+            while (position < text.size() && (isalnum((unsigned char) text[position]) || text[position] == '_'))
+                ++position;
+            std::string subject = text.substr(start, position - start);
+            if (subject.empty())
+                return fail("expected a test");
+
+            if (subject == "name" || subject == "source")
+                return parseKernelTest(subject);
+
+            CaptureFilter::Field field;
+            if (subject == "work_dim")
+                field = CaptureFilter::WORK_DIM;
+            else if (subject == "global_size")
+                field = CaptureFilter::GLOBAL_SIZE;
+            else if (subject == "local_size")
+                field = CaptureFilter::LOCAL_SIZE;
+            else if (subject == "bytes")
+                field = CaptureFilter::BUFFER_BYTES;
+            else if (subject == "launch")
+                field = CaptureFilter::LAUNCH;
+            else
+            {
+                position = start;
+                return fail("unknown test \"" + subject + "\"");
+            }
+
+            unsigned dimension = CaptureFilter::NoDimension;
+            if ((field == CaptureFilter::GLOBAL_SIZE || field == CaptureFilter::LOCAL_SIZE) && accept("["))
+            {
+                uint64_t value = 0;
+                if (!parseNumber(value) || value > 2)
+                    return fail("expected a dimension from 0 to 2");
+                if (!accept("]"))
+                    return fail("expected \"]\"");
+                dimension = value;
+            }
+
+            Instruction& instruction = filter.program[emit(Instruction::TEST_FIELD, dimension)];
+            instruction.field = field;
+            if (!parseComparison(instruction.comparison) || !parseNumber(instruction.value))
+                return false;
+
+            if (field == CaptureFilter::BUFFER_BYTES)
+                filter.bufferBytesUsed = true;
+            return true;
+        }
+};
+
+}
+
+bool CaptureFilter::configure(const std::string& text, std::string& error)
+{
+    CaptureFilter compiled;
+    FilterParser parser(text, compiled);
+    if (!parser.parse(error))
+        return false;
+
+    *this = compiled;
+    return true;
+}
+
+uint64_t CaptureFilter::matchKernel(const std::string& entryPointName, const Hash128& sourcesHash) const
+{
+    uint64_t matches = 0;
+    for (unsigned index = 0; index < kernelTests.size(); ++index)
+    {
+        const KernelTest& test = kernelTests[index];
+        bool match = false;
+        switch (test.kind)
+        {
+            case KernelTest::NAME_GLOB:
+                match = globMatch(test.pattern.c_str(), entryPointName.c_str());
+                break;
+            case KernelTest::NAME_REGEX:
+                match = std::regex_search(entryPointName, test.regex);
+                break;
+            case KernelTest::SOURCE_PREFIX:
+                match = sourcesHash.toHex().compare(0, test.pattern.size(), test.pattern) == 0;
+                break;
+        }
+
+        if (match)
+            matches |= uint64_t(1) << index;
+    }
+    return matches;
+}
+
+// Dimensions beyond ``workDim`` count as 1
+static uint64_t workSize(unsigned workDim, const size_t* sizes, unsigned dimension)
+{
+    if (dimension != CaptureFilter::NoDimension)
+        return dimension < workDim ? sizes[dimension] : 1;
+
+    uint64_t total = 1;
+    for (unsigned dim = 0; dim < workDim; ++dim)
+        total *= sizes[dim];
+    return total;
+}
+
+bool CaptureFilter::matches(const Launch& launch) const
+{
+    bool result = true;
+    for (size_t next = 0; next < program.size();)
+    {
+        const Instruction& instruction = program[next++];
+        switch (instruction.op)
+        {
+            case Instruction::TEST_KERNEL:
+                result = (launch.kernelMatches >> instruction.operand) & 1;
+                break;
+
+            case Instruction::TEST_FIELD:
+            {
+                uint64_t value = 0;
+                switch (instruction.field)
+                {
+                    case WORK_DIM:
+                        value = launch.workDim;
+                        break;
+                    case GLOBAL_SIZE:
+                        value = workSize(launch.workDim, launch.globalSize, instruction.operand);
+                        break;
+                    case LOCAL_SIZE:
+                        value = launch.localSize ? workSize(launch.workDim, launch.localSize, instruction.operand) : 0;
+                        break;
+                    case BUFFER_BYTES:
+                        value = launch.bufferBytes;
+                        break;
+                    case LAUNCH:
+                        value = launch.index;
+                        break;
+                }
+
+                switch (instruction.comparison)
+                {
+                    case LT: result = value < instruction.value; break;
+                    case LE: result = value <= instruction.value; break;
+                    case GT: result = value > instruction.value; break;
+                    case GE: result = value >= instruction.value; break;
+                    case EQ: result = value == instruction.value; break;
+                    case NE: result = value != instruction.value; break;
+                }
+                break;
+            }
+
+            case Instruction::NOT:
+                result = !result;
+                break;
+
+            case Instruction::JUMP_IF_FALSE:
+                if (!result)
+                    next = instruction.operand;
+                break;
+
+            case Instruction::JUMP_IF_TRUE:
+                if (result)
+                    next = instruction.operand;
+                break;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,117 @@
+#include "gvki/Hash.h"
+#include <cstring>
+
+// MurmurHash3 was written by Austin Appleby and placed in the public domain.
+// This follows MurmurHash3_x64_128() but can be fed data incrementally.
+
+using namespace gvki;
+
+static const uint64_t c1 = 0x87c37b91114253d5ULL;
+static const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+std::string Hash128::toHex() const
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string hex(32, '0');
+    for (int digit = 0; digit < 16; ++digit)
+    {
+        hex[15 - digit] = hexDigits[(high >> (4 * digit)) & 0xf];
+        hex[31 - digit] = hexDigits[(low >> (4 * digit)) & 0xf];
+    }
+    return hex;
+}
+
+Hasher::Hasher(uint64_t seed) : h1(seed), h2(seed), totalSize(0), tailSize(0)
+{
+}
+
+void Hasher::mixBlock(const unsigned char* block)
+{
+    uint64_t k1, k2;
+    memcpy(&k1, block, sizeof(k1));
+    memcpy(&k2, block + 8, sizeof(k2));
+
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+}
+
+void Hasher::update(const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    totalSize += size;
+
+    // Finish off a block started by a previous call
+    if (tailSize > 0)
+    {
+        size_t needed = sizeof(tail) - tailSize;
+        if (size < needed)
+        {
+            memcpy(tail + tailSize, bytes, size);
+            tailSize += size;
+            return;
+        }
+
+        memcpy(tail + tailSize, bytes, needed);
+        mixBlock(tail);
+        bytes += needed;
+        size -= needed;
+        tailSize = 0;
+    }
+
+    for (; size >= sizeof(tail); bytes += sizeof(tail), size -= sizeof(tail))
+        mixBlock(bytes);
+
+    memcpy(tail, bytes, size);
+    tailSize = size;
+}
+
+Hash128 Hasher::finish() const
+{
+    uint64_t f1 = h1;
+    uint64_t f2 = h2;
+
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (size_t index = tailSize; index > 8; --index)
+        k2 = (k2 << 8) | tail[index - 1];
+    for (size_t index = (tailSize < 8 ? tailSize : 8); index > 0; --index)
+        k1 = (k1 << 8) | tail[index - 1];
+
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; f2 ^= k2;
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; f1 ^= k1;
+
+    f1 ^= totalSize;
+    f2 ^= totalSize;
+
+    f1 += f2;
+    f2 += f1;
+
+    f1 = fmix64(f1);
+    f2 = fmix64(f2);
+
+    f1 += f2;
+    f2 += f1;
+
+    Hash128 result;
+    result.high = f1;
+    result.low = f2;
+    return result;
+}
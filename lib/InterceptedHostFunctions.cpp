@@ -20,9 +20,89 @@
 using namespace std;
 using namespace gvki;
 
-// If this is set to false, a given kernel object will support
-// just one invocation.
-#define __ALLOW_MULTIPLE_LOGGING false
+// Note the application dropping a reference to ``handle``. If it was the
+// last one the entry is evicted. This must be done before the underlying
+// release because once that returns the implementation can hand out the
+// same handle for a new object.
+template <typename Handle, typename Info>
+static void gvkiRelease(HandleRegistry<Handle, Info>& registry, Handle handle)
+{
+    if (registry.release(handle))
+        registry.erase(handle);
+}
+
+// Changes to the information registered for a program or kernel. They are
+// made with HandleRegistry::update() so they can't race with another thread
+// copying the information.
+struct SetCompileFlags
+{
+    std::string flags;
+
+    explicit SetCompileFlags(const char* options) : flags(options != NULL ? options : "") { }
+    void operator()(ProgramInfo& pi) const { pi.compileFlags = flags; }
+};
+
+struct SetArgument
+{
+    unsigned index;
+    size_t size;
+    const void* value;
+    uint64_t generation;
+
+    SetArgument(unsigned index, size_t size, const void* value, uint64_t generation) :
+        index(index), size(size), value(value), generation(generation) { }
+    void operator()(KernelInfo& ki) const { ki.setArgument(index, size, value, generation); }
+};
+
+// Brackets enqueueing a command that might change the contents of
+// buffers so snapshots of them taken earlier aren't reused. Must be
+// created before the underlying call and destroyed after it. Nothing
+// is tracked while disarmed because no snapshots are kept then.
+class BufferWrites
+{
+    public:
+        BufferWrites(cl_command_queue queue) : l(Logger::Singleton()), queue(queue), armed(l.arming.armed()) { }
+
+        ~BufferWrites()
+        {
+            for (unsigned index = 0; index < bufferIds.size(); ++index)
+                l.endBufferWrite(bufferIds[index]);
+        }
+
+        // Anything that isn't a buffer we know about is ignored
+        void add(cl_mem memObject)
+        {
+            if (!armed)
+                return;
+
+            uint64_t bufferId = l.buffers.generation(memObject);
+            if (bufferId == 0)
+                return;
+
+            l.beginBufferWrite(bufferId, queue);
+            bufferIds.push_back(bufferId);
+        }
+
+        void addKernel(const KernelInfo& ki)
+        {
+            if (!armed)
+                return;
+
+            size_t first = bufferIds.size();
+            l.kernelWrites(ki, bufferIds);
+            for (size_t index = first; index < bufferIds.size(); ++index)
+                l.beginBufferWrite(bufferIds[index], queue);
+        }
+
+    private:
+        Logger& l;
+        cl_command_queue queue;
+        bool armed;
+        std::vector<uint64_t> bufferIds;
+
+        BufferWrites(const BufferWrites&); /* = delete; */
+        BufferWrites& operator=(const BufferWrites&); /* = delete; */
+};
 
 extern "C" {
 
@@ -46,7 +126,17 @@ DEFN(clCreateBuffer)
         BufferInfo bi;
         bi.size = size;
         bi.flags = flags;
-        l.buffers[buffer] = bi;
+        bi.hasDestructorCallback = l.evictOnDestruction(buffer);
+        if (flags & CL_MEM_USE_HOST_PTR)
+            bi.hostPtr = host_ptr;
+        l.buffers.insert(buffer, bi);
+
+        // The application can change the contents through
+        // ``host_ptr`` without telling the implementation.
+        if (flags & CL_MEM_USE_HOST_PTR)
+            l.untrackBuffer(l.buffers.generation(buffer));
+        else if (flags & CL_MEM_COPY_HOST_PTR)
+            l.captureHostContents(buffer, host_ptr, size);
     }
 
     if (errcode_ret)
@@ -98,7 +188,8 @@ DEFN(clCreateImage2D)
         ImageInfo ii;
         ii.flags = flags;
         ii.type = CL_MEM_OBJECT_IMAGE2D;
-        l.images[img] = ii;
+        ii.hasDestructorCallback = l.evictOnDestruction(img);
+        l.images.insert(img, ii);
     }
 
     if (errcode_ret)
@@ -141,7 +232,8 @@ DEFN(clCreateImage3D)
         ImageInfo ii;
         ii.flags = flags;
         ii.type = CL_MEM_OBJECT_IMAGE3D;
-        l.images[img] = ii;
+        ii.hasDestructorCallback = l.evictOnDestruction(img);
+        l.images.insert(img, ii);
     }
 
     if (errcode_ret)
@@ -176,7 +268,12 @@ DEFN(clCreateImage)
         ImageInfo ii;
         ii.flags = flags;
         ii.type = image_desc->image_type;
-        l.images[img] = ii;
+        ii.hasDestructorCallback = l.evictOnDestruction(img);
+        l.images.insert(img, ii);
+
+        // Writes to the image change the buffer's contents
+        if (image_desc->buffer != NULL)
+            l.untrackBuffer(l.buffers.generation(image_desc->buffer));
     }
 
     if (errcode_ret)
@@ -185,7 +282,53 @@ DEFN(clCreateImage)
     return img;
 }
 #endif
-                        
+
+cl_int
+DEFN(clRetainMemObject)
+    (cl_mem memobj)
+{
+    DEBUG_MSG("Intercepted clRetainMemObject()");
+    cl_int success = UnderlyingCaller::Singleton().clRetainMemObjectU(memobj);
+
+    if (success == CL_SUCCESS && Logger::alive())
+    {
+        Logger& l = Logger::Singleton();
+        if (!l.buffers.retain(memobj))
+            l.images.retain(memobj);
+    }
+
+    return success;
+}
+
+cl_int
+DEFN(clReleaseMemObject)
+    (cl_mem memobj)
+{
+    DEBUG_MSG("Intercepted clReleaseMemObject()");
+    if (!Logger::alive())
+        return UnderlyingCaller::Singleton().clReleaseMemObjectU(memobj);
+
+    Logger& l = Logger::Singleton();
+
+    // Memory objects can outlive the application's last reference (e.g.
+    // while kernels using them are still queued). If we can we wait for
+    // the implementation to tell us they have gone.
+    if (BufferInfo* bi = l.buffers.lookup(memobj))
+    {
+        if (l.buffers.release(memobj) && !bi->hasDestructorCallback)
+        {
+            l.forgetBuffer(memobj);
+            l.buffers.erase(memobj);
+        }
+    }
+    else if (ImageInfo* ii = l.images.lookup(memobj))
+    {
+        if (l.images.release(memobj) && !ii->hasDestructorCallback)
+            l.images.erase(memobj);
+    }
+
+    return UnderlyingCaller::Singleton().clReleaseMemObjectU(memobj);
+}
 
 cl_sampler
 DEFN(clCreateSampler)
@@ -212,7 +355,7 @@ DEFN(clCreateSampler)
         si.normalized_coords = normalized_coords;
         si.addressing_mode = addressing_mode;
         si.filter_mode = filter_mode;
-        l.samplers[sampler] = si;
+        l.samplers.insert(sampler, si);
     }
 
     if (errcode_ret != NULL)
@@ -221,6 +364,29 @@ DEFN(clCreateSampler)
     return sampler;
 }
 
+cl_int
+DEFN(clRetainSampler)
+    (cl_sampler sampler)
+{
+    DEBUG_MSG("Intercepted clRetainSampler()");
+    cl_int success = UnderlyingCaller::Singleton().clRetainSamplerU(sampler);
+
+    if (success == CL_SUCCESS && Logger::alive())
+        Logger::Singleton().samplers.retain(sampler);
+
+    return success;
+}
+
+cl_int
+DEFN(clReleaseSampler)
+    (cl_sampler sampler)
+{
+    DEBUG_MSG("Intercepted clReleaseSampler()");
+    if (Logger::alive())
+        gvkiRelease(Logger::Singleton().samplers, sampler);
+    return UnderlyingCaller::Singleton().clReleaseSamplerU(sampler);
+}
+
 /* 5.6 Program objects */
 cl_program
 DEFN(clCreateProgramWithSource)
@@ -238,18 +404,19 @@ DEFN(clCreateProgramWithSource)
     if (success == CL_SUCCESS)
     {
         Logger& l = Logger::Singleton();
-        l.programs[program] = ProgramInfo();
 
-        // Make sure we work on the version in the container
-        // so we don't do lots of unnecessary copies
-        ProgramInfo& pi = l.programs[program];
-        
+        // Fill in the information before registering it
+        // so other threads never see it half initialised
+        ProgramInfo pi;
+        ProgramSources* sources = new ProgramSources();
+        pi.sources.reset(sources);
+
         if (lengths == NULL)
         {
             // All strings are null terminated
             for (int pIndex=0; pIndex < count; ++pIndex)
             {
-                pi.sources.push_back(std::string(strings[pIndex]));
+                sources->push_back(std::string(strings[pIndex]));
             }
         }
         else
@@ -260,15 +427,25 @@ DEFN(clCreateProgramWithSource)
                 if (lengths[pIndex] == 0)
                 {
                     // This particular string is null terminated
-                    pi.sources.push_back(std::string(strings[pIndex]));
+                    sources->push_back(std::string(strings[pIndex]));
                 }
                 else
                 {
                     size_t length = lengths[pIndex];
-                    pi.sources.push_back(std::string(strings[pIndex], length));
+                    sources->push_back(std::string(strings[pIndex], length));
                 }
             }
         }
+
+        // Hash the sources once here so the Logger can cheaply spot
+        // programs whose source it has already written.
+        Hasher hasher;
+        for (unsigned pIndex=0; pIndex < sources->size(); ++pIndex)
+            hasher.update((*sources)[pIndex].data(), (*sources)[pIndex].size());
+        pi.sourcesHash = hasher.finish();
+        DEBUG_MSG("Program " << program << " has sources hash " << pi.sourcesHash.toHex());
+
+        l.programs.insert(program, pi);
     }
 
     if (errcode_ret)
@@ -299,26 +476,102 @@ DEFN(clBuildProgram)
     {
         Logger& l = Logger::Singleton();
 
-        assert(l.programs.count(program) == 1 && "Program was not logged!");
-        // Make sure we work on the version in the container
-        // so we don't do lots of unnecessary copies
-        ProgramInfo& pi = l.programs[program];
-
-        if (options != NULL)
+        if (!l.programs.update(program, SetCompileFlags(options)))
         {
-            pi.compileFlags = std::string(options);
-        }
-        else
-        {
-            pi.compileFlags = std::string("");
+            assert(false && "Program was not logged!");
         }
     }
 
     return success;
 }
 
+cl_int
+DEFN(clRetainProgram)
+    (cl_program program)
+{
+    DEBUG_MSG("Intercepted clRetainProgram()");
+    cl_int success = UnderlyingCaller::Singleton().clRetainProgramU(program);
+
+    if (success == CL_SUCCESS && Logger::alive())
+        Logger::Singleton().programs.retain(program);
+
+    return success;
+}
+
+cl_int
+DEFN(clReleaseProgram)
+    (cl_program program)
+{
+    DEBUG_MSG("Intercepted clReleaseProgram()");
+    // Kernels have their own copy of the program's information
+    // so it doesn't matter if some are still alive
+    if (Logger::alive())
+        gvkiRelease(Logger::Singleton().programs, program);
+    return UnderlyingCaller::Singleton().clReleaseProgramU(program);
+}
+
 /* 5.7 Kernel objects */
 
+#ifdef CL_VERSION_1_2
+// Returns UNKNOWN if the implementation can't tell us
+static ArgInfo::Declaration gvkiGetArgumentDeclaration(cl_kernel kernel, cl_uint index)
+{
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+
+    cl_kernel_arg_address_qualifier addressQualifier;
+    if (uc.clGetKernelArgInfoU(kernel, index, CL_KERNEL_ARG_ADDRESS_QUALIFIER,
+                               sizeof(addressQualifier), &addressQualifier, NULL) != CL_SUCCESS)
+        return ArgInfo::UNKNOWN;
+
+    if (addressQualifier == CL_KERNEL_ARG_ADDRESS_LOCAL)
+        return ArgInfo::LOCAL;
+
+    size_t typeNameSize = 0;
+    if (uc.clGetKernelArgInfoU(kernel, index, CL_KERNEL_ARG_TYPE_NAME,
+                               0, NULL, &typeNameSize) != CL_SUCCESS || typeNameSize == 0)
+        return ArgInfo::UNKNOWN;
+
+    std::string typeName(typeNameSize, '\0');
+    if (uc.clGetKernelArgInfoU(kernel, index, CL_KERNEL_ARG_TYPE_NAME,
+                               typeNameSize, &typeName[0], NULL) != CL_SUCCESS)
+        return ArgInfo::UNKNOWN;
+    typeName.resize(strlen(typeName.c_str()));
+
+    // Pointers can only be __global or __constant here
+    if (!typeName.empty() && typeName[typeName.size() - 1] == '*')
+        return ArgInfo::BUFFER;
+
+    if (typeName.compare(0, 5, "image") == 0)
+        return ArgInfo::IMAGE;
+
+    if (typeName == "sampler_t")
+        return ArgInfo::SAMPLER;
+
+    // Anything else that isn't private (e.g. a pipe) we don't understand
+    return addressQualifier == CL_KERNEL_ARG_ADDRESS_PRIVATE ? ArgInfo::VALUE : ArgInfo::UNKNOWN;
+}
+
+// False if the kernel is declared as only reading buffer argument ``index``
+static bool gvkiKernelMayWriteArgument(cl_kernel kernel, cl_uint index)
+{
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+
+    cl_kernel_arg_address_qualifier addressQualifier;
+    if (uc.clGetKernelArgInfoU(kernel, index, CL_KERNEL_ARG_ADDRESS_QUALIFIER,
+                               sizeof(addressQualifier), &addressQualifier, NULL) == CL_SUCCESS &&
+        addressQualifier == CL_KERNEL_ARG_ADDRESS_CONSTANT)
+        return false;
+
+    cl_kernel_arg_type_qualifier typeQualifier;
+    if (uc.clGetKernelArgInfoU(kernel, index, CL_KERNEL_ARG_TYPE_QUALIFIER,
+                               sizeof(typeQualifier), &typeQualifier, NULL) == CL_SUCCESS &&
+        (typeQualifier & CL_KERNEL_ARG_TYPE_CONST))
+        return false;
+
+    return true;
+}
+#endif
+
 void static gvkiSetupKernelArguments(cl_kernel kernel, KernelInfo& ki)
 {
     cl_uint numberOfArgs = 0;
@@ -342,6 +595,27 @@ void static gvkiSetupKernelArguments(cl_kernel kernel, KernelInfo& ki)
     {
         ki.arguments.push_back( ArgInfo() );
     }
+
+#ifdef CL_VERSION_1_2
+    // Knowing how the arguments are declared saves us guessing what the
+    // values passed to clSetKernelArg() are. The declarations can't change
+    // so they are only asked for once per kernel.
+    for (cl_uint index=0; index < numberOfArgs; ++index)
+    {
+        ArgInfo::Declaration declaration = gvkiGetArgumentDeclaration(kernel, index);
+        if (declaration == ArgInfo::UNKNOWN)
+        {
+            // Most likely the program wasn't built with -cl-kernel-arg-info
+            // so the other arguments won't be any different
+            DEBUG_MSG("Argument information not available for kernel, guessing argument types");
+            break;
+        }
+        ki.arguments[index].declaration = declaration;
+
+        if (declaration == ArgInfo::BUFFER)
+            ki.arguments[index].kernelMayWrite = gvkiKernelMayWriteArgument(kernel, index);
+    }
+#endif
 }
 
 cl_kernel
@@ -354,21 +628,24 @@ DEFN(clCreateKernel)
     DEBUG_MSG("Intercepted clCreateKernel()");
 
     cl_int success = CL_SUCCESS;
-    cl_kernel kernel = UnderlyingCaller::Singleton().clCreateKernelU(program, kernel_name, errcode_ret);
-    if ( success == CL_SUCCESS)
+    cl_kernel kernel = UnderlyingCaller::Singleton().clCreateKernelU(program, kernel_name, &success);
+    if (success == CL_SUCCESS && kernel != NULL)
     {
         Logger& l = Logger::Singleton();
-        l.kernels[kernel] = KernelInfo();
 
-        assert(l.programs.count(program) == 1 && "Program was not logged!");
-
-        // Make sure we work on the version in the container
-        // so we don't do lots of unnecessary copies
-        KernelInfo& ki = l.kernels[kernel];
-        ki.program = program;
+        // Fill in the information before registering it
+        // so other threads never see it half initialised
+        KernelInfo ki;
+        if (!l.programs.lookup(program, ki.program))
+        {
+            assert(false && "Program was not logged!");
+        }
         ki.entryPointName = std::string(kernel_name);
         gvkiSetupKernelArguments(kernel, ki);
         ki.loggedAlready = false;
+        ki.sampling = l.sampler.entryPoint(ki.entryPointName);
+        ki.filterMatches = l.filter.matchKernel(ki.entryPointName, ki.program.sourcesHash);
+        l.kernels.insert(kernel, ki);
 
         DEBUG_MSG("Kernel \"" << ki.entryPointName << "\" created");
     }
@@ -395,16 +672,21 @@ DEFN(clCreateKernelsInProgram)
     {
         Logger& l = Logger::Singleton();
         assert(num_kernels > 0 && "num_kernels had an invalid value");
-        assert(l.programs.count(program) == 1 && "Program was not logged!");
+        ProgramInfo pi;
+        if (!l.programs.lookup(program, pi))
+        {
+            assert(false && "Program was not logged!");
+        }
 
         for(int i=0; i < num_kernels; ++i)
         {
             cl_kernel k = kernels[i];
-            l.kernels[k] = KernelInfo();
 
-            // Make sure we work on the version in the container
-            KernelInfo& ki = l.kernels[k];
-            ki.program = program;
+            // Fill in the information before registering it
+            // so other threads never see it half initialised
+            KernelInfo ki;
+            ki.program = pi;
+            ki.loggedAlready = false;
 
             // Get the entry point name
             size_t stringSize = 0;
@@ -443,8 +725,11 @@ DEFN(clCreateKernelsInProgram)
             }
 
             ki.entryPointName = std::string(kernelName);
+            ki.sampling = l.sampler.entryPoint(ki.entryPointName);
+            ki.filterMatches = l.filter.matchKernel(ki.entryPointName, ki.program.sourcesHash);
 
             gvkiSetupKernelArguments(k, ki);
+            l.kernels.insert(k, ki);
 
             DEBUG_MSG("Kernel \"" << ki.entryPointName << "\" created");
             free(kernelName);
@@ -471,48 +756,46 @@ DEFN(clSetKernelArg)
     {
         Logger& l = Logger::Singleton();
 
-        assert (l.kernels.count(kernel) == 1 && "Kernel was not logged");
-        KernelInfo& ki = l.kernels[kernel];
+        KernelInfo* kiPtr = l.kernels.lookup(kernel);
+        assert (kiPtr != NULL && "Kernel was not logged");
+        KernelInfo& ki = *kiPtr;
 
         assert( ki.arguments.size() > 0 && "Can't set argument on kernel that does not take any arguments");
         assert(arg_index <= ( ki.arguments.size() -1) && "Invalid argument index for kernel");
-        ArgInfo& ai = ki.arguments[arg_index];
-
-        if (ai.argValue != NULL)
-        {
-            // We must have malloc()'ed from a previous call to this
-            // function so free the pointer
-            free((void*) ai.argValue);
-        }
 
-        if (arg_value == NULL)
-        {
-            // The client is allowed to set arg_value to NULL (e.g. for __local memory)
-            ai.argValue = NULL;
-        }
-        else
-        {
-            // The user is allowed to do whatever
-            // they want with the memory pointed
-            // to by ``arg_value`` so we need to
-            // copy its contents.
-            //
-            // FIXME: We aren't always free'ing the memory
-            // allocated here because we aren't tracking
-            // cl_kernel or cl_context destruction
-            ai.argValue = malloc(arg_size);
-            memcpy((void*) ai.argValue, arg_value, arg_size);
-        }
+        // The client is allowed to set arg_value to NULL (e.g. for __local
+        // memory). Otherwise they can do whatever they want with the memory
+        // pointed to by ``arg_value`` so we need to copy its contents.
+        uint64_t generation = l.objectGeneration(ki.arguments[arg_index].declaration, arg_value, arg_size);
+        l.kernels.update(kernel, SetArgument(arg_index, arg_size, arg_value, generation));
+    }
 
-        ai.argSize = arg_size;
+    return success;
+}
 
+cl_int
+DEFN(clRetainKernel)
+    (cl_kernel kernel)
+{
+    DEBUG_MSG("Intercepted clRetainKernel()");
+    cl_int success = UnderlyingCaller::Singleton().clRetainKernelU(kernel);
 
-        ki.arguments[arg_index] = ai;
-    }
+    if (success == CL_SUCCESS && Logger::alive())
+        Logger::Singleton().kernels.retain(kernel);
 
     return success;
 }
 
+cl_int
+DEFN(clReleaseKernel)
+    (cl_kernel kernel)
+{
+    DEBUG_MSG("Intercepted clReleaseKernel()");
+    if (Logger::alive())
+        gvkiRelease(Logger::Singleton().kernels, kernel);
+    return UnderlyingCaller::Singleton().clReleaseKernelU(kernel);
+}
+
 /* 5.8 Executing kernels */
 cl_int
 DEFN(clEnqueueNDRangeKernel)
@@ -529,130 +812,440 @@ DEFN(clEnqueueNDRangeKernel)
 {
     DEBUG_MSG("Intercepted clEnqueueNDRangeKernel()");
 
-
     Logger& l = Logger::Singleton();
-    assert(l.kernels.count(kernel) == 1 && "kernel was not logged");
-    KernelInfo& ki = l.kernels[kernel];
-    if (__ALLOW_MULTIPLE_LOGGING || !ki.loggedAlready)
+    if (!l.arming.armed())
+    {
+        return UnderlyingCaller::Singleton().clEnqueueNDRangeKernelU(command_queue,
+                                                                     kernel,
+                                                                     work_dim,
+                                                                     global_work_offset,
+                                                                     global_work_size,
+                                                                     local_work_size,
+                                                                     num_events_in_wait_list,
+                                                                     event_wait_list,
+                                                                     event);
+    }
+
+    KernelInfo* kiPtr = l.kernels.lookup(kernel);
+    assert(kiPtr != NULL && "kernel was not logged");
+    KernelInfo& ki = *kiPtr;
+
+    // The events the kernel must wait for. With asynchronous snapshots
+    // the kernel must also wait for the reads so it can't modify
+    // the buffers before they have been copied.
+    std::vector<cl_event> kernelWaitList(event_wait_list, event_wait_list + num_events_in_wait_list);
+
+    // Only build the record here. Writing it out
+    // is left to the Logger's writer thread.
+    // Launches that won't be logged are decided on before anything else is done
+    std::unique_lock<std::mutex> logGuard(l.logLock);
+    unsigned slot = 0;
+    Sampler::Decision decision = Sampler::SKIP;
+    if (l.armedLaunch() && l.filterLaunch(ki, work_dim, global_work_size, local_work_size))
+        decision = l.sampler.decide(ki, slot);
+    if (decision != Sampler::SKIP)
     {
-        for (unsigned argIndex = 0; argIndex < ki.arguments.size(); ++argIndex)
+        bool writerIsFull = l.writerIsFull();
+        if (writerIsFull && l.writerFullPolicy == Logger::DROP_RECORD)
         {
-            if (BufferInfo *bi = l.tryGetBuffer(ki.arguments[argIndex]))
+            ++l.droppedRecords;
+        }
+        else
+        {
+            bool dropData = writerIsFull && l.writerFullPolicy == Logger::DROP_DATA;
+            if (dropData)
+                ++l.recordsWithoutData;
+
+            InvocationRecord* record = l.recordInvocation(command_queue,
+                                                          kernel,
+                                                          work_dim,
+                                                          global_work_offset,
+                                                          global_work_size,
+                                                          local_work_size,
+                                                          num_events_in_wait_list,
+                                                          event_wait_list,
+                                                          !dropData);
+
+            std::vector<BufferSnapshot*> snapshots = record->snapshots();
+            for (unsigned index = 0; index < snapshots.size(); ++index)
             {
-                if (bi->flags == CL_MEM_READ_ONLY || bi->flags == CL_MEM_READ_WRITE)
+                // Hold our own reference to the read event because the
+                // writer thread might release it before the kernel is enqueued.
+                if (snapshots[index]->readEvent != NULL)
                 {
-                    assert(bi->data == NULL && "Data field of buffer should not be set between kernel invocations");
-                    bi->data = new char[bi->size];
-
-                    cl_mem memObject;
-                    bool found = false;
-                    for (std::map<cl_mem, BufferInfo>::iterator it = l.buffers.begin(), end = l.buffers.end();
-                      it != end;
-                      ++it)
-                    {
-                        if (&(it->second) == bi) {
-                            found = true;
-                            memObject = it->first;
-                            break;
-                        }
-                    }
-                    assert(found && "Memory object corresponding to buffer must exist");
-
-                    cl_int success = UnderlyingCaller::Singleton().clEnqueueReadBufferU(
-                                        command_queue,
-                                        memObject,
-                                        CL_TRUE,
-                                        0,
-                                        bi->size,
-                                        bi->data,
-                                        0,
-                                        NULL,
-                                        NULL);
-                    // TODO: what should we do when API calls made for purposes of interception fail?
+                    UnderlyingCaller::Singleton().clRetainEventU(snapshots[index]->readEvent);
+                    kernelWaitList.push_back(snapshots[index]->readEvent);
                 }
             }
+
+            // Held launches have their data written now so only
+            // their JSON waits in the reservoir until the end.
+            if (decision == Sampler::HOLD)
+                l.sampler.hold(ki, slot, record);
+            // A record without data is small so it's allowed
+            // to go over the writer's limit.
+            l.submit(record, /*force=*/dropData);
+            ki.loggedAlready = true;
+            l.arming.logged();
         }
+    }
+    logGuard.unlock();
+
+    // Done after the snapshots have been taken because
+    // they must not be reused once the kernel has run.
+    BufferWrites writes(command_queue);
+    writes.addKernel(ki);
+
+    cl_int result = UnderlyingCaller::Singleton().clEnqueueNDRangeKernelU(command_queue,
+                                                                          kernel,
+                                                                          work_dim,
+                                                                          global_work_offset,
+                                                                          global_work_size,
+                                                                          local_work_size,
+                                                                          kernelWaitList.size(),
+                                                                          kernelWaitList.empty() ? NULL : &(kernelWaitList[0]),
+                                                                          event);
+
+    // Drop the references we took on the snapshot reads
+    for (unsigned index = num_events_in_wait_list; index < kernelWaitList.size(); ++index)
+    {
+        UnderlyingCaller::Singleton().clReleaseEventU(kernelWaitList[index]);
+    }
 
-        {
-          ki.dimensions = work_dim;
+    // Make sure the snapshot reads get submitted even if the
+    // application never flushes the queue.
+    if (kernelWaitList.size() > num_events_in_wait_list)
+        UnderlyingCaller::Singleton().clFlushU(command_queue);
 
-          // Assume the local size is concrete
-          ki.localWorkSizeIsUnconstrained = false;
+    return result;
+    
+}
 
-          // Resize recorded NDRange vectors if necessary
-          if (ki.globalWorkOffset.size() != work_dim)
-            ki.globalWorkOffset.resize(work_dim);
+cl_int
+DEFN(clEnqueueTask)
+    (cl_command_queue command_queue,
+     cl_kernel        kernel,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueTask()");
+    BufferWrites writes(command_queue);
+    if (KernelInfo* ki = Logger::Singleton().kernels.lookup(kernel))
+        writes.addKernel(*ki);
+
+    return UnderlyingCaller::Singleton().clEnqueueTaskU(command_queue,
+                                                        kernel,
+                                                        num_events_in_wait_list,
+                                                        event_wait_list,
+                                                        event);
+}
 
-          if (ki.globalWorkSize.size() != work_dim)
-            ki.globalWorkSize.resize(work_dim);
+cl_int
+DEFN(clEnqueueNativeKernel)
+    (cl_command_queue  command_queue,
+     void (CL_CALLBACK * user_func)(void *),
+     void *            args,
+     size_t            cb_args,
+     cl_uint           num_mem_objects,
+     const cl_mem *    mem_list,
+     const void **     args_mem_loc,
+     cl_uint           num_events_in_wait_list,
+     const cl_event *  event_wait_list,
+     cl_event *        event)
+{
+    DEBUG_MSG("Intercepted clEnqueueNativeKernel()");
+    BufferWrites writes(command_queue);
+    for (cl_uint index = 0; index < num_mem_objects; ++index)
+        writes.add(mem_list[index]);
+
+    return UnderlyingCaller::Singleton().clEnqueueNativeKernelU(command_queue,
+                                                                user_func,
+                                                                args,
+                                                                cb_args,
+                                                                num_mem_objects,
+                                                                mem_list,
+                                                                args_mem_loc,
+                                                                num_events_in_wait_list,
+                                                                event_wait_list,
+                                                                event);
+}
 
-          if (ki.localWorkSize.size() != work_dim)
-            ki.localWorkSize.resize(work_dim);
+/* 5.2 Buffer objects. Commands that might change the contents of buffers
+ * are intercepted so snapshots of buffers that haven't changed since
+ * they were last read can be reused.
+ */
+cl_int
+DEFN(clEnqueueWriteBuffer)
+    (cl_command_queue command_queue,
+     cl_mem           buffer,
+     cl_bool          blocking_write,
+     size_t           offset,
+     size_t           size,
+     const void *     ptr,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueWriteBuffer()");
+    BufferWrites writes(command_queue);
+    writes.add(buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueWriteBufferU(command_queue,
+                                                               buffer,
+                                                               blocking_write,
+                                                               offset,
+                                                               size,
+                                                               ptr,
+                                                               num_events_in_wait_list,
+                                                               event_wait_list,
+                                                               event);
+}
 
-          for (int dim = 0; dim < work_dim; ++dim)
-          {
-            if (global_work_offset != NULL)
-            {
-              ki.globalWorkOffset[dim] = global_work_offset[dim];
-            }
-            else
-            {
-              ki.globalWorkOffset[dim] = 0;
-            }
+cl_int
+DEFN(clEnqueueCopyBuffer)
+    (cl_command_queue command_queue,
+     cl_mem           src_buffer,
+     cl_mem           dst_buffer,
+     size_t           src_offset,
+     size_t           dst_offset,
+     size_t           size,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueCopyBuffer()");
+    BufferWrites writes(command_queue);
+    writes.add(dst_buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueCopyBufferU(command_queue,
+                                                              src_buffer,
+                                                              dst_buffer,
+                                                              src_offset,
+                                                              dst_offset,
+                                                              size,
+                                                              num_events_in_wait_list,
+                                                              event_wait_list,
+                                                              event);
+}
 
-            ki.globalWorkSize[dim] = global_work_size[dim];
+#ifdef CL_VERSION_1_1
+cl_int
+DEFN(clEnqueueWriteBufferRect)
+    (cl_command_queue command_queue,
+     cl_mem           buffer,
+     cl_bool          blocking_write,
+     const size_t *   buffer_origin,
+     const size_t *   host_origin,
+     const size_t *   region,
+     size_t           buffer_row_pitch,
+     size_t           buffer_slice_pitch,
+     size_t           host_row_pitch,
+     size_t           host_slice_pitch,
+     const void *     ptr,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueWriteBufferRect()");
+    BufferWrites writes(command_queue);
+    writes.add(buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueWriteBufferRectU(command_queue,
+                                                                   buffer,
+                                                                   blocking_write,
+                                                                   buffer_origin,
+                                                                   host_origin,
+                                                                   region,
+                                                                   buffer_row_pitch,
+                                                                   buffer_slice_pitch,
+                                                                   host_row_pitch,
+                                                                   host_slice_pitch,
+                                                                   ptr,
+                                                                   num_events_in_wait_list,
+                                                                   event_wait_list,
+                                                                   event);
+}
 
-            if (local_work_size != NULL)
-            {
-              ki.localWorkSize[dim] = local_work_size[dim];
-            }
-            else
-            {
-              // It is implementation defined how to divide the NDRange
-              // in this case. We will emit that the local size is unconstrained
-              ki.localWorkSizeIsUnconstrained = true;
+cl_int
+DEFN(clEnqueueCopyBufferRect)
+    (cl_command_queue command_queue,
+     cl_mem           src_buffer,
+     cl_mem           dst_buffer,
+     const size_t *   src_origin,
+     const size_t *   dst_origin,
+     const size_t *   region,
+     size_t           src_row_pitch,
+     size_t           src_slice_pitch,
+     size_t           dst_row_pitch,
+     size_t           dst_slice_pitch,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueCopyBufferRect()");
+    BufferWrites writes(command_queue);
+    writes.add(dst_buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueCopyBufferRectU(command_queue,
+                                                                  src_buffer,
+                                                                  dst_buffer,
+                                                                  src_origin,
+                                                                  dst_origin,
+                                                                  region,
+                                                                  src_row_pitch,
+                                                                  src_slice_pitch,
+                                                                  dst_row_pitch,
+                                                                  dst_slice_pitch,
+                                                                  num_events_in_wait_list,
+                                                                  event_wait_list,
+                                                                  event);
+}
+#endif
 
-              // Set the values to something, it doesn't really matter what
-              // because we shouldn't write them
-              ki.localWorkSize[dim] = 0;
-            }
-          }
+#ifdef CL_VERSION_1_2
+cl_int
+DEFN(clEnqueueFillBuffer)
+    (cl_command_queue command_queue,
+     cl_mem           buffer,
+     const void *     pattern,
+     size_t           pattern_size,
+     size_t           offset,
+     size_t           size,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueFillBuffer()");
+    BufferWrites writes(command_queue);
+    writes.add(buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueFillBufferU(command_queue,
+                                                              buffer,
+                                                              pattern,
+                                                              pattern_size,
+                                                              offset,
+                                                              size,
+                                                              num_events_in_wait_list,
+                                                              event_wait_list,
+                                                              event);
+}
 
+cl_int
+DEFN(clEnqueueMigrateMemObjects)
+    (cl_command_queue       command_queue,
+     cl_uint                num_mem_objects,
+     const cl_mem *         mem_objects,
+     cl_mem_migration_flags flags,
+     cl_uint                num_events_in_wait_list,
+     const cl_event *       event_wait_list,
+     cl_event *             event)
+{
+    DEBUG_MSG("Intercepted clEnqueueMigrateMemObjects()");
+    BufferWrites writes(command_queue);
 
-          // Log stuff now.
-          // We need to do this now because the kernel information
-          // might be modified later.
-          l.dump(kernel);
+    // Migrating normally keeps the contents
+    if (flags & CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED)
+    {
+        for (cl_uint index = 0; index < num_mem_objects; ++index)
+            writes.add(mem_objects[index]);
+    }
 
-          for (unsigned argIndex = 0; argIndex < ki.arguments.size(); ++argIndex)
-          {
-            if (BufferInfo *bi = l.tryGetBuffer(ki.arguments[argIndex]))
-            {
-              if (bi->flags == CL_MEM_READ_ONLY || bi->flags == CL_MEM_READ_WRITE)
-              {
-                assert(bi->data != NULL && "Data field of buffer should not be null after kernel invocation");
-                delete bi->data;
-                bi->data = NULL;
-              }
-            }
-          }
+    return UnderlyingCaller::Singleton().clEnqueueMigrateMemObjectsU(command_queue,
+                                                                     num_mem_objects,
+                                                                     mem_objects,
+                                                                     flags,
+                                                                     num_events_in_wait_list,
+                                                                     event_wait_list,
+                                                                     event);
+}
+#endif
 
-        }
-    }
+cl_int
+DEFN(clEnqueueCopyImageToBuffer)
+    (cl_command_queue command_queue,
+     cl_mem           src_image,
+     cl_mem           dst_buffer,
+     const size_t *   src_origin,
+     const size_t *   region,
+     size_t           dst_offset,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueCopyImageToBuffer()");
+    BufferWrites writes(command_queue);
+    writes.add(dst_buffer);
+
+    return UnderlyingCaller::Singleton().clEnqueueCopyImageToBufferU(command_queue,
+                                                                     src_image,
+                                                                     dst_buffer,
+                                                                     src_origin,
+                                                                     region,
+                                                                     dst_offset,
+                                                                     num_events_in_wait_list,
+                                                                     event_wait_list,
+                                                                     event);
+}
 
-    ki.loggedAlready = true;
+void *
+DEFN(clEnqueueMapBuffer)
+    (cl_command_queue command_queue,
+     cl_mem           buffer,
+     cl_bool          blocking_map,
+     cl_map_flags     map_flags,
+     size_t           offset,
+     size_t           size,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event,
+     cl_int *         errcode_ret)
+{
+    DEBUG_MSG("Intercepted clEnqueueMapBuffer()");
+    // The application can change the mapped region until it is
+    // unmapped. Unmapping counts as a write too so snapshots taken
+    // in between aren't reused.
+    BufferWrites writes(command_queue);
+    if (map_flags & CL_MAP_WRITE)
+        writes.add(buffer);
+#ifdef CL_VERSION_1_2
+    else if (map_flags & CL_MAP_WRITE_INVALIDATE_REGION)
+        writes.add(buffer);
+#endif
 
-    return UnderlyingCaller::Singleton().clEnqueueNDRangeKernelU(command_queue,
-                                                                 kernel,
-                                                                 work_dim,
-                                                                 global_work_offset,
-                                                                 global_work_size,
-                                                                 local_work_size,
-                                                                 num_events_in_wait_list,
-                                                                 event_wait_list,
-                                                                 event);
+    return UnderlyingCaller::Singleton().clEnqueueMapBufferU(command_queue,
+                                                             buffer,
+                                                             blocking_map,
+                                                             map_flags,
+                                                             offset,
+                                                             size,
+                                                             num_events_in_wait_list,
+                                                             event_wait_list,
+                                                             event,
+                                                             errcode_ret);
+}
 
-    
+cl_int
+DEFN(clEnqueueUnmapMemObject)
+    (cl_command_queue command_queue,
+     cl_mem           memobj,
+     void *           mapped_ptr,
+     cl_uint          num_events_in_wait_list,
+     const cl_event * event_wait_list,
+     cl_event *       event)
+{
+    DEBUG_MSG("Intercepted clEnqueueUnmapMemObject()");
+    // We don't know how the region was mapped so any
+    // unmapping is assumed to have changed it.
+    BufferWrites writes(command_queue);
+    writes.add(memobj);
+
+    return UnderlyingCaller::Singleton().clEnqueueUnmapMemObjectU(command_queue,
+                                                                  memobj,
+                                                                  mapped_ptr,
+                                                                  num_events_in_wait_list,
+                                                                  event_wait_list,
+                                                                  event);
 }
 
 }
@@ -0,0 +1,142 @@
+#include "gvki/JSONWriter.h"
+
+using namespace gvki;
+
+// "00" to "99", two characters per entry
+static const char decimalPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hexDigits[] = "0123456789abcdef";
+
+JSONWriter::JSONWriter(const char* path) : file(path, std::ofstream::out | std::ofstream::ate),
+                                           buffer(new char[BufferSize]),
+                                           used(0),
+                                           capture(NULL)
+{
+}
+
+JSONWriter::~JSONWriter()
+{
+    close();
+    delete [] buffer;
+}
+
+void JSONWriter::writeUnsigned(uint64_t value)
+{
+    // Enough for 2^64 - 1
+    char digits[20];
+    char* start = digits + sizeof(digits);
+
+    while (value >= 100)
+    {
+        unsigned pair = (unsigned) (value % 100) * 2;
+        value /= 100;
+        *--start = decimalPairs[pair + 1];
+        *--start = decimalPairs[pair];
+    }
+
+    if (value >= 10)
+    {
+        *--start = decimalPairs[value * 2 + 1];
+        *--start = decimalPairs[value * 2];
+    }
+    else
+        *--start = (char) ('0' + value);
+
+    append(start, digits + sizeof(digits) - start);
+}
+
+void JSONWriter::writeString(const std::string& s)
+{
+    *this << '"';
+    for (size_t index = 0; index < s.size(); ++index)
+    {
+        unsigned char c = s[index];
+        if (c == '"' || c == '\\')
+        {
+            *this << '\\' << (char) c;
+        }
+        else if (c < 0x20)
+        {
+            // Control characters have to be written as \u00XX
+            *this << "\\u00";
+            writeHexReversed(&c, 1);
+        }
+        else
+            *this << (char) c;
+    }
+    *this << '"';
+}
+
+void JSONWriter::writeHexReversed(const unsigned char* bytes, size_t size)
+{
+    char chunk[256];
+    size_t inChunk = 0;
+    for (size_t index = size; index > 0; --index)
+    {
+        unsigned char byte = bytes[index - 1];
+        chunk[inChunk++] = hexDigits[byte >> 4];
+        chunk[inChunk++] = hexDigits[byte & 0xf];
+        if (inChunk == sizeof(chunk))
+        {
+            append(chunk, inChunk);
+            inChunk = 0;
+        }
+    }
+    append(chunk, inChunk);
+}
+
+void JSONWriter::writeOut(const char* data, size_t size)
+{
+    if (capture != NULL)
+        capture->append(data, size);
+    else
+        file.write(data, size);
+}
+
+void JSONWriter::drain()
+{
+    if (used > 0)
+    {
+        writeOut(buffer, used);
+        used = 0;
+    }
+}
+
+void JSONWriter::flush()
+{
+    drain();
+    if (capture == NULL)
+        file.flush();
+}
+
+void JSONWriter::beginCapture(std::string& target)
+{
+    // What was written before belongs in the file
+    drain();
+    capture = &target;
+}
+
+void JSONWriter::endCapture()
+{
+    drain();
+    capture = NULL;
+}
+
+void JSONWriter::close()
+{
+    if (!file.is_open())
+        return;
+
+    flush();
+    file.close();
+}
@@ -1,24 +1,76 @@
 #include "gvki/Logger.h"
 #include "gvki/PathSeperator.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cstdio>
 #include <cassert>
 #include <errno.h>
+#include <signal.h>
 #include <iostream>
-#include <iomanip>
 #include <sstream>
 #include <stdint.h>
 #include "string.h"
 #include "gvki/Debug.h"
+#include "gvki/UnderlyingCaller.h"
 
 #include <sys/stat.h>
 
 #ifndef _WIN32
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #define MKDIR_FAILS(d)     (mkdir(d, 0770) != 0)
 #define DIR_ALREADY_EXISTS (errno == EEXIST)
+// Opens a file for writing only if it doesn't already exist
+#define CREATE_NEW_FILE(f) open(f, O_WRONLY | O_CREAT | O_EXCL, 0666)
+#define OPEN_OR_CREATE(f)  open(f, O_RDWR | O_CREAT, 0666)
+#define FD_TO_FILE(fd, m)  fdopen(fd, m)
+#define CLOSE_FD(fd)       close(fd)
+
+// Waits until no other process holds the lock
+static bool lockFile(int fd) {
+    return flock(fd, LOCK_EX) == 0;
+}
+
+static void unlockFile(int fd) {
+    flock(fd, LOCK_UN);
+}
+
+// Create ``path`` with room for ``size`` bytes and map it. Returns NULL
+// on failure. The space is allocated up front because running out of
+// space while writing to a mapping would crash the application.
+static char* mapNewFile(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd == -1)
+        return NULL;
+
+    void* mapping = MAP_FAILED;
+    int error = posix_fallocate(fd, 0, size);
+    if (error == 0)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        error = errno;
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        unlink(path);
+        errno = error;
+        return NULL;
+    }
+    return (char*) mapping;
+}
+
+static void unmapFile(char* data, size_t size) {
+    munmap(data, size);
+}
+
+// Smaller snapshots are cheaper in memory the allocator already has
+static const size_t DefaultMappedSnapshotSize = 16 << 20;
 
 static void checkDirectoryExists(const char* dirName) {
     DIR* dh = opendir(dirName);
@@ -27,307 +79,1563 @@ static void checkDirectoryExists(const char* dirName) {
         closedir(dh);
         return;
     }
-    ERROR_MSG(strerror(errno) << ". Directory was :" << dirName);
-    exit(1);
-}
+    ERROR_MSG(strerror(errno) << ". Directory was :" << dirName);
+    exit(1);
+}
+
+#else
+
+#include <inttypes.h>
+#include <fcntl.h>
+#include <io.h>
+#include <Windows.h>
+#define MKDIR_FAILS(d)     (CreateDirectory(d, NULL) == 0)
+#define DIR_ALREADY_EXISTS (GetLastError() == ERROR_ALREADY_EXISTS)
+#define CREATE_NEW_FILE(f) _open(f, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define OPEN_OR_CREATE(f)  _open(f, _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define FD_TO_FILE(fd, m)  _fdopen(fd, m)
+#define CLOSE_FD(fd)       _close(fd)
+
+// Waits until no other process holds the lock
+static bool lockFile(int fd) {
+    OVERLAPPED overlapped = {0};
+    return LockFileEx((HANDLE) _get_osfhandle(fd), LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped) != 0;
+}
+
+static void unlockFile(int fd) {
+    OVERLAPPED overlapped = {0};
+    UnlockFileEx((HANDLE) _get_osfhandle(fd), 0, 1, 0, &overlapped);
+}
+
+// FIXME: Use CreateFileMapping()
+static char* mapNewFile(const char* path, size_t size) {
+    return NULL;
+}
+
+static void unmapFile(char* data, size_t size) {
+}
+
+static const size_t DefaultMappedSnapshotSize = 0;
+
+static void checkDirectoryExists(const char* dirName) {
+    DWORD ftyp = GetFileAttributesA(dirName);
+    if ((ftyp != INVALID_FILE_ATTRIBUTES) && ftyp & FILE_ATTRIBUTE_DIRECTORY)
+        return;
+    ERROR_MSG(strerror(errno) << ". Directory was :" << dirName);
+    exit(1);
+}
+
+#endif
+
+using namespace std;
+using namespace gvki;
+
+void KernelInfo::setArgument(unsigned index, size_t size, const void* value, uint64_t generation)
+{
+    ArgInfo& ai = arguments[index];
+    ai.argSize = size;
+    ai.hasValue = value != NULL;
+    ai.generation = generation;
+    if (value == NULL)
+        return;
+
+    if (size <= ArgInfo::InlineSize)
+    {
+        memcpy(ai.inlineValue, value, size);
+        return;
+    }
+
+    if (size > ai.arenaCapacity)
+    {
+        // The old space is abandoned. Reserving at least double means an
+        // argument that keeps growing wastes no more than it uses.
+        ai.arenaCapacity = std::max(size, 2 * ai.arenaCapacity);
+        ai.arenaOffset = argArena.size();
+        argArena.resize(argArena.size() + ai.arenaCapacity);
+    }
+    memcpy(&argArena[ai.arenaOffset], value, size);
+}
+
+// Cleared as soon as the Logger starts being destroyed. Being a plain
+// atomic it is still valid when other static destructors run.
+static std::atomic<bool> loggerAlive(false);
+
+bool Logger::alive()
+{
+    return loggerAlive.load(std::memory_order_acquire);
+}
+
+Logger& Logger::Singleton()
+{
+    static Logger l;
+    return l;
+}
+
+static size_t writerQueueLength()
+{
+    const char* length = getenv("GVKI_WRITER_QUEUE_LENGTH");
+    if (!length)
+        return 64;
+
+    char* end = NULL;
+    unsigned long value = strtoul(length, &end, 10);
+    if (*length == '\0' || *end != '\0' || value == 0)
+    {
+        ERROR_MSG("GVKI_WRITER_QUEUE_LENGTH must be a positive integer");
+        exit(1);
+    }
+    return value;
+}
+
+static size_t streamingChunkSize()
+{
+    const char* size = getenv("GVKI_SNAPSHOT_CHUNK_SIZE");
+    if (!size)
+        return 64 << 20;
+
+    char* end = NULL;
+    unsigned long long value = strtoull(size, &end, 10);
+    if (*size == '\0' || *end != '\0' || value == 0)
+    {
+        ERROR_MSG("GVKI_SNAPSHOT_CHUNK_SIZE must be a positive number of bytes");
+        exit(1);
+    }
+    return value;
+}
+
+static size_t memoryLimit(const char* variable, size_t defaultLimit)
+{
+    const char* size = getenv(variable);
+    if (!size)
+        return defaultLimit;
+
+    char* end = NULL;
+    unsigned long long value = strtoull(size, &end, 10);
+    if (*size == '\0' || *end != '\0')
+    {
+        ERROR_MSG(variable << " must be a number of bytes");
+        exit(1);
+    }
+    return value;
+}
+
+static size_t minimumMappedSnapshotSize()
+{
+    const char* size = getenv("GVKI_MAPPED_SNAPSHOT_SIZE");
+    if (!size)
+        return DefaultMappedSnapshotSize;
+
+    char* end = NULL;
+    unsigned long long value = strtoull(size, &end, 10);
+    if (*size == '\0' || *end != '\0')
+    {
+        ERROR_MSG("GVKI_MAPPED_SNAPSHOT_SIZE must be a number of bytes");
+        exit(1);
+    }
+    // Mapped snapshots aren't supported everywhere
+    return DefaultMappedSnapshotSize == 0 ? 0 : value;
+}
+
+Logger::Logger() : snapshotMemory(memoryLimit("GVKI_SNAPSHOT_MEMORY", 1 << 30)), snapshotPool(snapshotMemory),
+                   shadowMemory(memoryLimit("GVKI_SHADOW_MEMORY", 256 << 20)),
+                   pendingRecords(writerQueueLength())
+{
+    loggerAlive = true;
+    duplicateSnapshots = 0;
+    reusedSnapshots = 0;
+    hostSnapshots = 0;
+    mappedSnapshots = 0;
+    streamedSnapshots = 0;
+    spilledSnapshots = 0;
+    snapshotsOverBudget = 0;
+    temporaryFiles = 0;
+    shadowedSnapshots = 0;
+    shadowFallbacks = 0;
+    filteredLaunches = 0;
+    recordsWithoutData = 0;
+    droppedRecords = 0;
+    firstRecord = true;
+
+    asyncSnapshots = getenv("GVKI_ASYNC_SNAPSHOTS") != NULL;
+    mappedSnapshotSize = minimumMappedSnapshotSize();
+    snapshotChunkSize = streamingChunkSize();
+    shadowSnapshots = getenv("GVKI_SHADOW_SNAPSHOTS") != NULL;
+    initWriterConfig();
+    initSampling();
+    initFilter();
+    initArming();
+
+    // FIXME: Reading from the environment probably doesn't belong in here
+    // but it makes implementing the singleton a lot easier
+    const char* doNotUseNumberedDirs = getenv("GVKI_NO_NUM_DIRS");
+    if (doNotUseNumberedDirs)
+    {
+        DEBUG_MSG("Using manual directory");
+        const char* rootDir = getenv("GVKI_ROOT");
+        if (!rootDir)
+        {
+            ERROR_MSG("If using GVKI_NO_NUM_DIRS then GVKI_ROOT must be specified");
+            _exit(1);
+        }
+        initDirectoryManual(rootDir);
+    }
+    else
+    {
+        DEBUG_MSG("Using numbered directory");
+        initDirectoryNumbered();
+    }
+    checkDirectoryExists(this->directory.c_str());
+    DEBUG_MSG("Directory used for logging is \"" << this->directory << "\"");
+
+    openLog();
+    writerThread = std::thread(&Logger::writeRecords, this);
+}
+
+void Logger::initWriterConfig()
+{
+    writerFullPolicy = BLOCK;
+
+    const char* policy = getenv("GVKI_WRITER_FULL_POLICY");
+    if (!policy)
+        return;
+
+    if (strcmp(policy, "block") == 0)
+        writerFullPolicy = BLOCK;
+    else if (strcmp(policy, "drop-data") == 0)
+        writerFullPolicy = DROP_DATA;
+    else if (strcmp(policy, "drop-record") == 0)
+        writerFullPolicy = DROP_RECORD;
+    else
+    {
+        ERROR_MSG("GVKI_WRITER_FULL_POLICY must be one of \"block\", \"drop-data\" or \"drop-record\"");
+        exit(1);
+    }
+}
+
+void Logger::initSampling()
+{
+    const char* spec = getenv("GVKI_SAMPLE");
+    if (spec && !sampler.configure(spec))
+    {
+        ERROR_MSG("GVKI_SAMPLE \"" << spec << "\" is not a comma separated list of \"once\", \"all\", "
+                  "\"every=N\", \"first=N\", \"probability=P\", \"rate=N/SECONDS\" or a final \"reservoir=N\"");
+        exit(1);
+    }
+
+    // Makes probability and reservoir sampling repeatable
+    const char* seed = getenv("GVKI_SAMPLE_SEED");
+    if (seed)
+        sampler.seed(strtoull(seed, NULL, 10));
+}
+
+void Logger::initFilter()
+{
+    const char* text = getenv("GVKI_FILTER");
+    const char* path = getenv("GVKI_FILTER_FILE");
+    if (text && path)
+    {
+        ERROR_MSG("Only one of GVKI_FILTER and GVKI_FILTER_FILE can be set");
+        exit(1);
+    }
+
+    std::string spec;
+    if (text)
+        spec = text;
+    else if (path)
+    {
+        std::ifstream file(path);
+        if (!file.good())
+        {
+            ERROR_MSG("Failed to open GVKI_FILTER_FILE \"" << path << "\"");
+            exit(1);
+        }
+        std::stringstream ss;
+        ss << file.rdbuf();
+        spec = ss.str();
+    }
+    else
+        return;
+
+    std::string error;
+    if (!filter.configure(spec, error))
+    {
+        ERROR_MSG("Bad capture filter: " << error);
+        exit(1);
+    }
+}
+
+// A number of seconds or launches for which gvki stays armed
+static double armingLimit(const char* variable)
+{
+    const char* limit = getenv(variable);
+    if (!limit)
+        return 0;
+
+    char* end = NULL;
+    double value = strtod(limit, &end);
+    if (*limit == '\0' || *end != '\0' || value < 0)
+    {
+        ERROR_MSG(variable << " must be a number that isn't negative");
+        exit(1);
+    }
+    return value;
+}
+
+void Logger::initArming()
+{
+    const char* trigger = getenv("GVKI_ARM_FILE");
+    if (!getenv("GVKI_DISARMED") && !trigger)
+        return;
+
+    arming.configure((uint64_t) armingLimit("GVKI_ARM_LAUNCHES"), armingLimit("GVKI_ARM_SECONDS"));
+#ifdef SIGUSR1
+    // GVKI_ARM_FILE on its own doesn't take the signal from the application
+    if (getenv("GVKI_DISARMED"))
+        arming.armOnSignal(SIGUSR1);
+#endif
+
+    std::string error;
+    if (trigger && !arming.armOnTrigger(trigger, error))
+    {
+        ERROR_MSG("Can't use GVKI_ARM_FILE \"" << trigger << "\": " << error);
+        exit(1);
+    }
+}
+
+void Logger::initDirectoryManual(const char* rootDir)
+{
+    assert(rootDir && "rootDir cannot be NULL");
+
+    if (MKDIR_FAILS(rootDir))
+    {
+        ERROR_MSG("Failed to create directory \"" << rootDir << ": " << strerror(errno));
+        _exit(1);
+    }
+    this->directory = std::string(rootDir);
+}
+
+static bool directoryExists(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR);
+}
+
+void Logger::initDirectoryNumbered()
+{
+    std::string directoryPrefix;
+
+    const char* envTemp = getenv("GVKI_ROOT");
+    if (envTemp)
+    {
+        DEBUG_MSG("Using GVKI_ROOT value as destination for directories");
+
+        checkDirectoryExists(envTemp);
+
+        directoryPrefix = envTemp;
+
+    }
+    else
+    {
+        // Use the current working directory
+        DEBUG_MSG("Using current working directory as destination for directories");
+
+        // FIXME: Hard-coding this size is gross
+        #define MAX_DIR_LENGTH 1024
+
+#ifndef _WIN32
+        char cwdArray[MAX_DIR_LENGTH];
+        char* cwdResult = getcwd(cwdArray, sizeof(cwdArray)/sizeof(char));
+        if (!cwdResult)
+#else
+        char cwdResult[MAX_DIR_LENGTH];
+        if (GetCurrentDirectory(MAX_DIR_LENGTH, cwdResult) == 0)
+#endif
+        {
+            ERROR_MSG(strerror(errno) << ". Could not read the current working directory");
+            exit(1);
+        }
+        else
+            directoryPrefix = cwdResult;
+    }
+    directoryPrefix += PATH_SEP "gvki";
+    DEBUG_MSG("Directory prefix is \"" << directoryPrefix << "\"");
+
+    // Rather than trying gvki-0, gvki-1, ... in turn the next number to
+    // use is kept in a counter file next to the directories. Processes
+    // sharing GVKI_ROOT lock the file while they create their directory.
+    // mkdir() is what stops two processes using the same directory so if
+    // the counter is missing, stale or can't be locked (e.g. on some
+    // network file systems) we just end up trying a few more numbers.
+    std::string counterPath = directoryPrefix + "-next";
+    unsigned count = 0;
+    FILE* counter = NULL;
+    int counterFd = OPEN_OR_CREATE(counterPath.c_str());
+    if (counterFd == -1)
+    {
+        DEBUG_MSG(strerror(errno) << ". Could not open \"" << counterPath << "\"");
+    }
+    else
+    {
+        if (!lockFile(counterFd))
+        {
+            DEBUG_MSG(strerror(errno) << ". Could not lock \"" << counterPath << "\"");
+        }
+
+        counter = FD_TO_FILE(counterFd, "r+b");
+        if (!counter)
+            CLOSE_FD(counterFd);
+    }
+
+    unsigned next = 0;
+    if (counter && fscanf(counter, "%u", &next) == 1 && next > 0)
+    {
+        // If the last directory handed out has gone then the old output
+        // was cleaned up so start numbering from the beginning again
+        stringstream last;
+        last << directoryPrefix << "-" << (next - 1);
+        if (directoryExists(last.str()))
+            count = next;
+    }
+
+    while (true)
+    {
+        stringstream ss;
+        ss <<  directoryPrefix << "-" << count;
+        ++count;
+
+        // Make the directoryPrefix
+        if (MKDIR_FAILS(ss.str().c_str()))
+        {
+            if (!DIR_ALREADY_EXISTS)
+            {
+                ERROR_MSG(strerror(errno) << ". Directory was :" << directoryPrefix);
+                exit(1);
+            }
+
+            // It already exists, try again
+            continue;
+        }
+
+        this->directory = ss.str();
+        break;
+    }
+
+    if (counter)
+    {
+        // Fixed width so a smaller number completely overwrites a larger one
+        rewind(counter);
+        fprintf(counter, "%010u\n", count);
+        fflush(counter);
+        unlockFile(counterFd);
+        fclose(counter);
+    }
+}
+
+
+void Logger::openLog()
+{
+    // FIXME: We should use mkstemp() or something
+    std::stringstream ss;
+    ss << directory << PATH_SEP << "log.json";
+    output = new JSONWriter(ss.str().c_str());
+
+    if (! output->good())
+    {
+        ERROR_MSG("Failed to create file (" << ss.str() <<  ") to write log to");
+        exit(1);
+    }
+
+    // Start of JSON array
+    *output << "[\n";
+}
+
+void Logger::closeLog()
+{
+    assert(output != NULL && "output must not be NULL");
+    // End of JSON array
+    *output << "\n]\n";
+    output->close();
+}
+
+Logger::~Logger()
+{
+    loggerAlive = false;
+
+    // Let the writer finish everything that was logged
+    pendingRecords.close();
+    if (writerThread.joinable())
+        writerThread.join();
+
+    // Launches held in reservoirs are logged once there are no more
+    // launches that could replace them. Their data is already written.
+    std::vector<std::shared_ptr<std::string> > held = sampler.takeHeldRecords();
+    for (unsigned index = 0; index < held.size(); ++index)
+    {
+        separateRecord();
+        *output << *held[index];
+    }
+
+    if (recordsWithoutData > 0)
+    {
+        ERROR_MSG(recordsWithoutData << " kernel invocations were logged without buffer data because the writer was full");
+    }
+
+    if (droppedRecords > 0)
+    {
+        ERROR_MSG(droppedRecords << " kernel invocations were not logged because the writer was full");
+    }
+
+    if (snapshotsOverBudget > 0)
+    {
+        ERROR_MSG(snapshotsOverBudget << " buffer snapshots could not be taken because GVKI_SNAPSHOT_MEMORY ran out");
+    }
+
+    DEBUG_MSG(writtenSnapshots.size() << " buffer snapshots written, " << duplicateSnapshots << " duplicates skipped, "
+              << reusedSnapshots << " reused without reading the buffer again, "
+              << hostSnapshots << " copied from host memory, " << mappedSnapshots << " in mapped files, "
+              << streamedSnapshots << " streamed");
+    DEBUG_MSG("Snapshot memory: " << snapshotMemory.peakUse() << " bytes at most of "
+              << snapshotMemory.getLimit() << ", " << snapshotPool.allocations() << " allocations, "
+              << snapshotPool.reuses() << " reused, " << spilledSnapshots << " snapshots spilled to mapped files");
+    if (arming.isDisarmable())
+    {
+        DEBUG_MSG("Armed " << arming.timesArmed() << " times");
+    }
+    DEBUG_MSG(filteredLaunches << " kernel launches were filtered out, "
+              << sampler.skipped() << " were not sampled");
+    if (shadowSnapshots)
+    {
+        DEBUG_MSG(shadowedSnapshots << " snapshots copied on the device, " << shadowFallbacks
+                  << " read directly instead. Shadow memory: " << shadowMemory.peakUse()
+                  << " bytes at most of " << shadowMemory.getLimit());
+    }
+    DEBUG_MSG("Live (evicted) buffers: " << buffers.liveCount() << " (" << buffers.evictedCount() << ")"
+              << ", images: " << images.liveCount() << " (" << images.evictedCount() << ")"
+              << ", samplers: " << samplers.liveCount() << " (" << samplers.evictedCount() << ")"
+              << ", programs: " << programs.liveCount() << " (" << programs.evictedCount() << ")"
+              << ", kernels: " << kernels.liveCount() << " (" << kernels.evictedCount() << ")");
+
+    closeLog();
+    delete output;
+    writeDeviceTable();
+}
+
+#ifdef CL_VERSION_1_1
+// Called by the implementation just before it destroys ``memObject``
+static void CL_CALLBACK memObjectDestroyed(cl_mem memObject, void* userData)
+{
+    // Implementations destroy what is left at exit, maybe after the Logger
+    if (!Logger::alive())
+        return;
+
+    Logger* l = (Logger*) userData;
+    l->forgetBuffer(memObject);
+    if (!l->buffers.erase(memObject))
+        l->images.erase(memObject);
+}
+#endif
+
+bool Logger::evictOnDestruction(cl_mem memObject)
+{
+#ifdef CL_VERSION_1_1
+    cl_int success = UnderlyingCaller::Singleton().clSetMemObjectDestructorCallbackU(memObject,
+                                                                                     memObjectDestroyed,
+                                                                                     this);
+    return success == CL_SUCCESS;
+#else
+    return false;
+#endif
+}
+
+int cl_error_check(cl_int err, const char *err_string) {
+  if (err == CL_SUCCESS)
+    return 0;
+  printf("%s: %d\n", err_string, err);
+  return 1;
+}
+
+BufferSnapshot::~BufferSnapshot()
+{
+    // Before readEvent is released because it might be the stream's
+    releaseStream();
+
+    if (readEvent != NULL)
+        UnderlyingCaller::Singleton().clReleaseEventU(readEvent);
+
+    releaseData();
+    releaseShadow();
+
+    if (!temporaryFile.empty())
+        remove(temporaryFile.c_str());
+}
+
+void BufferSnapshot::releaseData()
+{
+    if (data == NULL)
+        return;
+
+    if (mapped)
+        unmapFile(data, size);
+    else
+        pool->release(data, size);
+
+    data = NULL;
+}
+
+void BufferSnapshot::releaseShadow()
+{
+    if (shadow == NULL)
+        return;
+
+    UnderlyingCaller::Singleton().clReleaseMemObjectU(shadow);
+    shadowMemory->release(size);
+    shadow = NULL;
+}
+
+void BufferSnapshot::releaseStream()
+{
+    if (stream == NULL)
+        return;
+
+#ifdef CL_VERSION_1_2
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+    if (readEvent != NULL && !stream->completed)
+        uc.clSetUserEventStatusU(readEvent, CL_COMPLETE);
+    if (stream->after != NULL)
+        uc.clReleaseEventU(stream->after);
+    uc.clReleaseMemObjectU(memObject);
+#endif
+
+    for (unsigned index = 0; index < 2; ++index)
+    {
+        if (stream->chunks[index] != NULL)
+            pool->release(stream->chunks[index], stream->chunkSize);
+    }
+
+    delete stream;
+    stream = NULL;
+}
+
+void BufferSnapshot::swapContents(BufferSnapshot& other)
+{
+    std::swap(data, other.data);
+    std::swap(mapped, other.mapped);
+    std::swap(pool, other.pool);
+    temporaryFile.swap(other.temporaryFile);
+    std::swap(hashed, other.hashed);
+    std::swap(contents, other.contents);
+}
+
+void Logger::beginBufferWrite(uint64_t bufferId, cl_command_queue queue)
+{
+    if (bufferId == 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    BufferHistory& history = bufferHistory[bufferId];
+    ++history.writes;
+    ++history.writesInProgress;
+    history.lastWriteQueue = queue;
+    history.snapshot.reset();
+}
+
+void Logger::endBufferWrite(uint64_t bufferId)
+{
+    if (bufferId == 0)
+        return;
+
+    // Also counted as a write so a snapshot taken while the
+    // command was being enqueued isn't kept
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    BufferHistory& history = bufferHistory[bufferId];
+    assert(history.writesInProgress > 0 && "endBufferWrite() without beginBufferWrite()");
+    ++history.writes;
+    --history.writesInProgress;
+    history.snapshot.reset();
+}
+
+void Logger::kernelWrites(const KernelInfo& ki, std::vector<uint64_t>& bufferIds)
+{
+    for (unsigned index = 0; index < ki.arguments.size(); ++index)
+    {
+        const ArgInfo& ai = ki.arguments[index];
+        BufferInfo bi;
+        if (!ai.kernelMayWrite || !tryGetBuffer(ai, ki.argumentValue(index), bi))
+            continue;
+
+        if ((bi.flags & CL_MEM_READ_ONLY) == 0)
+            bufferIds.push_back(ai.generation);
+    }
+}
+
+void Logger::captureHostContents(cl_mem memObject, const void* hostPtr, size_t size)
+{
+    // Snapshots aren't kept while disarmed
+    if (!arming.armed())
+        return;
+
+    uint64_t bufferId = buffers.generation(memObject);
+    if (bufferId == 0)
+        return;
+
+    // Nothing can have written to the buffer yet
+    rememberSnapshot(bufferId, 0, NULL, copySnapshot(memObject, hostPtr, size));
+}
+
+void Logger::untrackBuffer(uint64_t bufferId)
+{
+    if (bufferId == 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    BufferHistory& history = bufferHistory[bufferId];
+    history.untracked = true;
+    history.snapshot.reset();
+}
+
+void Logger::forgetBuffer(cl_mem memObject)
+{
+    uint64_t bufferId = buffers.generation(memObject);
+    if (bufferId == 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    bufferHistory.erase(bufferId);
+}
+
+void Logger::forgetSnapshots()
+{
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    for (std::unordered_map<uint64_t, BufferHistory>::iterator b = bufferHistory.begin(), e = bufferHistory.end();
+         b != e; ++b)
+    {
+        // As if written on a queue we don't know
+        BufferHistory& history = b->second;
+        ++history.writes;
+        history.lastWriteQueue = NULL;
+        history.snapshot.reset();
+    }
+}
+
+std::shared_ptr<BufferSnapshot> Logger::cleanSnapshot(uint64_t bufferId, uint64_t& writes)
+{
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    BufferHistory& history = bufferHistory[bufferId];
+    writes = history.writes;
+    if (history.writesInProgress > 0)
+        return std::shared_ptr<BufferSnapshot>();
+
+    return history.snapshot;
+}
+
+void Logger::rememberSnapshot(uint64_t bufferId, uint64_t writes, cl_command_queue queue,
+                              const std::shared_ptr<BufferSnapshot>& snapshot)
+{
+    std::lock_guard<std::mutex> guard(bufferHistoryLock);
+    BufferHistory& history = bufferHistory[bufferId];
+    if (history.untracked || history.writesInProgress > 0 || history.writes != writes)
+        return;
+
+    // A write enqueued elsewhere might not have happened yet
+    if (history.writes > 0 && history.lastWriteQueue != queue)
+        return;
+
+    history.snapshot = snapshot;
+}
+
+std::vector<BufferSnapshot*> InvocationRecord::snapshots() const
+{
+    std::vector<BufferSnapshot*> unique;
+    for (unsigned argIndex=0; argIndex < arguments.size(); ++argIndex)
+    {
+        BufferSnapshot* snapshot = arguments[argIndex].snapshot.get();
+        if (snapshot == NULL)
+            continue;
+
+        bool seen = false;
+        for (unsigned index=0; index < unique.size(); ++index)
+            seen = seen || (unique[index] == snapshot);
+
+        if (!seen)
+            unique.push_back(snapshot);
+    }
+    return unique;
+}
+
+static std::string getDeviceString(cl_device_id device, cl_device_info param)
+{
+    size_t size = 0;
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+    if (uc.clGetDeviceInfoU(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+        return std::string();
+
+    std::vector<char> value(size);
+    if (uc.clGetDeviceInfoU(device, param, size, &(value[0]), NULL) != CL_SUCCESS)
+        return std::string();
+
+    // Drop the NUL terminator
+    return std::string(&(value[0]));
+}
+
+const DeviceInfo* Logger::getDevice(cl_command_queue queue)
+{
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+
+    cl_device_id device = NULL;
+    cl_int success = uc.clGetCommandQueueInfoU(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+    if (success != CL_SUCCESS || device == NULL)
+    {
+        ERROR_MSG("Failed to get the device for queue " << queue << " (" << success << ")");
+        return NULL;
+    }
+
+    if (const DeviceInfo* known = devices.lookup(device))
+        return known;
+
+    DeviceInfo di;
+    di.id = deviceTable.size();
+
+    cl_bool littleEndian = CL_TRUE;
+    uc.clGetDeviceInfoU(device, CL_DEVICE_ENDIAN_LITTLE, sizeof(cl_bool), &littleEndian, NULL);
+    di.littleEndian = (littleEndian == CL_TRUE);
+
+    di.name = getDeviceString(device, CL_DEVICE_NAME);
+    di.vendor = getDeviceString(device, CL_DEVICE_VENDOR);
+    di.driverVersion = getDeviceString(device, CL_DRIVER_VERSION);
+    uc.clGetDeviceInfoU(device, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint), &(di.addressBits), NULL);
+    uc.clGetDeviceInfoU(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &(di.maxWorkGroupSize), NULL);
+
+    deviceTable.push_back(device);
+    return devices.insert(device, di);
+}
+
+void Logger::writeDeviceTable()
+{
+    std::stringstream ss;
+    ss << directory << PATH_SEP << "devices.json";
+    JSONWriter table(ss.str().c_str());
+    if (!table.good())
+    {
+        ERROR_MSG("Failed to create file (" << ss.str() << ") to write device table to");
+        return;
+    }
+
+    table << "[\n";
+    for (unsigned index=0; index < deviceTable.size(); ++index)
+    {
+        const DeviceInfo* di = devices.lookup(deviceTable[index]);
+        assert(di != NULL && "device missing");
+
+        table << "{\n\"id\": " << di->id << ",\n";
+        table << "\"name\": ";
+        table.writeString(di->name);
+        table << ",\n\"vendor\": ";
+        table.writeString(di->vendor);
+        table << ",\n\"driver_version\": ";
+        table.writeString(di->driverVersion);
+        table << ",\n\"endianness\": \"" << (di->littleEndian ? "little" : "big") << "\",\n";
+        table << "\"address_bits\": " << di->addressBits << ",\n";
+        table << "\"max_work_group_size\": " << di->maxWorkGroupSize << "\n}";
+
+        if (index != deviceTable.size() - 1)
+            table << ",";
+        table << "\n";
+    }
+    table << "]\n";
+}
+
+bool Logger::armedLaunch()
+{
+    bool justArmed = false;
+    bool open = arming.windowOpen(justArmed);
+    // Drop snapshots on the way in and out because the
+    // writes enqueued while disarmed aren't tracked
+    if (justArmed || !open)
+        forgetSnapshots();
+    if (justArmed)
+    {
+        DEBUG_MSG("Armed");
+    }
+    return open;
+}
+
+bool Logger::filterLaunch(KernelInfo& ki, cl_uint workDim, const size_t* globalWorkSize,
+                          const size_t* localWorkSize)
+{
+    uint64_t index = ki.sampling->launched++;
+    if (filter.empty())
+        return true;
+
+    CaptureFilter::Launch launch;
+    launch.kernelMatches = ki.filterMatches;
+    launch.workDim = workDim;
+    launch.globalSize = globalWorkSize;
+    launch.localSize = localWorkSize;
+    launch.bufferBytes = filter.needsBufferBytes() ? bufferBytes(ki) : 0;
+    launch.index = index;
+    if (filter.matches(launch))
+        return true;
+
+    ++filteredLaunches;
+    return false;
+}
+
+uint64_t Logger::bufferBytes(const KernelInfo& ki)
+{
+    uint64_t total = 0;
+    for (unsigned argIndex = 0; argIndex < ki.arguments.size(); ++argIndex)
+    {
+        BufferInfo bi;
+        const void* argValue = ki.argumentValue(argIndex);
+        if (argValue != NULL && tryGetBuffer(ki.arguments[argIndex], argValue, bi))
+            total += bi.size;
+    }
+    return total;
+}
+
+InvocationRecord* Logger::recordInvocation(cl_command_queue queue,
+                                           cl_kernel kernel,
+                                           cl_uint workDim,
+                                           const size_t* globalWorkOffset,
+                                           const size_t* globalWorkSize,
+                                           const size_t* localWorkSize,
+                                           cl_uint numEvents,
+                                           const cl_event* waitList,
+                                           bool takeSnapshots)
+{
+    KernelInfo* kiPtr = kernels.lookup(kernel);
+    assert(kiPtr != NULL && "cl_kernel missing");
+    KernelInfo& ki = *kiPtr;
+
+    InvocationRecord* record = new InvocationRecord();
+    record->program = ki.program;
+    record->kernelCall = ki;
+    record->entryPointName = ki.entryPointName;
+    record->device = getDevice(queue);
+
+    record->globalWorkOffset.resize(workDim);
+    record->globalWorkSize.resize(workDim);
+    record->localWorkSize.resize(workDim);
+    for (unsigned dim = 0; dim < workDim; ++dim)
+    {
+        record->globalWorkOffset[dim] = (globalWorkOffset != NULL) ? globalWorkOffset[dim] : 0;
+        record->globalWorkSize[dim] = globalWorkSize[dim];
+
+        if (localWorkSize != NULL)
+        {
+            record->localWorkSize[dim] = localWorkSize[dim];
+        }
+        else
+        {
+            // It is implementation defined how to divide the NDRange
+            // in this case. We will emit that the local size is unconstrained
+            record->localWorkSizeIsUnconstrained = true;
+
+            // Set the values to something, it doesn't really matter what
+            // because we shouldn't write them
+            record->localWorkSize[dim] = 0;
+        }
+    }
+
+    record->arguments.resize(ki.arguments.size());
+    for (unsigned argIndex = 0; argIndex < ki.arguments.size(); ++argIndex)
+    {
+        ArgRecord& ar = record->arguments[argIndex];
+        const void* argValue = ki.argumentValue(argIndex);
+        recordArgument(ki.arguments[argIndex], argValue, ar);
+
+        if (!takeSnapshots || ar.kind != ArgRecord::ARRAY)
+            continue;
+
+        // The kernel can't read the buffer
+        if (ar.flags & CL_MEM_WRITE_ONLY)
+            continue;
+
+        cl_mem memObject = *((const cl_mem*) argValue);
+
+        // The same buffer might be passed as several arguments
+        for (unsigned previous = 0; previous < argIndex; ++previous)
+        {
+            const std::shared_ptr<BufferSnapshot>& other = record->arguments[previous].snapshot;
+            if (other != NULL && other->memObject == memObject)
+            {
+                ar.snapshot = other;
+                break;
+            }
+        }
+
+        if (ar.snapshot != NULL)
+            continue;
+
+        // If nothing can have written to the buffer since
+        // it was last read there's no need to read it again
+        uint64_t bufferId = ki.arguments[argIndex].generation;
+        uint64_t writes = 0;
+        ar.snapshot = cleanSnapshot(bufferId, writes);
+        if (ar.snapshot != NULL)
+        {
+            ++reusedSnapshots;
+            continue;
+        }
+
+        // Until the device writes to a CL_MEM_USE_HOST_PTR buffer its
+        // contents are the application's memory. Those buffers are never
+        // reused because the application can change that memory.
+        BufferInfo bi;
+        if (writes == 0 && (ar.flags & CL_MEM_USE_HOST_PTR) &&
+            tryGetBuffer(ki.arguments[argIndex], argValue, bi) && bi.hostPtr != NULL)
+        {
+            ar.snapshot = copySnapshot(memObject, bi.hostPtr, ar.size);
+            continue;
+        }
+
+        // The reads honour the application's wait list so
+        // they see what the kernel would have seen.
+        ar.snapshot = takeSnapshot(queue, memObject, ar.size, numEvents, waitList);
+        if (ar.snapshot != NULL)
+            rememberSnapshot(bufferId, writes, queue, ar.snapshot);
+    }
+
+    return record;
+}
+
+void Logger::submit(InvocationRecord* record, bool force)
+{
+    if (force)
+        pendingRecords.forcePush(record);
+    else
+        pendingRecords.push(record);
+}
+
+std::string Logger::newTemporaryFile()
+{
+    std::stringstream ss;
+    ss << directory << PATH_SEP << "snapshot-" << temporaryFiles++ << ".tmp";
+    return ss.str();
+}
+
+std::shared_ptr<BufferSnapshot> Logger::mapSnapshot(cl_mem memObject, size_t size)
+{
+    // It is named after its contents once they are known
+    std::string temporaryFile = newTemporaryFile();
+    char* data = mapNewFile(temporaryFile.c_str(), size);
+    if (data == NULL)
+    {
+        DEBUG_MSG(strerror(errno) << ". Could not map \"" << temporaryFile << "\"");
+        return std::shared_ptr<BufferSnapshot>();
+    }
+
+    ++mappedSnapshots;
+    return std::shared_ptr<BufferSnapshot>(new BufferSnapshot(memObject, size, data, temporaryFile));
+}
+
+std::shared_ptr<BufferSnapshot> Logger::newSnapshot(cl_mem memObject, size_t size)
+{
+    std::shared_ptr<BufferSnapshot> snapshot;
+    if (mappedSnapshotSize > 0 && size >= mappedSnapshotSize)
+        snapshot = mapSnapshot(memObject, size);
+
+    if (snapshot == NULL)
+    {
+        if (char* data = snapshotPool.allocate(size))
+            snapshot.reset(new BufferSnapshot(memObject, size, data, &snapshotPool));
+    }
+
+    // Out of memory. A file can always be mapped if there is disk space.
+    if (snapshot == NULL && DefaultMappedSnapshotSize > 0)
+    {
+        snapshot = mapSnapshot(memObject, size);
+        if (snapshot != NULL)
+            ++spilledSnapshots;
+    }
+
+    if (snapshot == NULL)
+        ++snapshotsOverBudget;
+
+    return snapshot;
+}
+
+std::shared_ptr<BufferSnapshot> Logger::copySnapshot(cl_mem memObject, const void* hostPtr, size_t size)
+{
+    std::shared_ptr<BufferSnapshot> snapshot;
+    if (size > snapshotChunkSize)
+        snapshot = streamHostSnapshot(memObject, hostPtr, size);
+    else if ((snapshot = newSnapshot(memObject, size)) != NULL)
+        memcpy(snapshot->data, hostPtr, size);
+
+    if (snapshot != NULL)
+        ++hostSnapshots;
+    return snapshot;
+}
+
+std::shared_ptr<BufferSnapshot> Logger::streamHostSnapshot(cl_mem memObject, const void* hostPtr, size_t size)
+{
+    // The host memory is already there so it can be
+    // written straight out without being copied first
+    std::string temporaryFile = newTemporaryFile();
+    std::ofstream file(temporaryFile.c_str(), std::ios::out | std::ios::binary);
+    file.write((const char*) hostPtr, size);
+    file.close();
+    if (!file.good())
+    {
+        ERROR_MSG("Failed to write snapshot of buffer " << memObject << " to \"" << temporaryFile << "\"");
+        remove(temporaryFile.c_str());
+        return std::shared_ptr<BufferSnapshot>();
+    }
+
+    ++streamedSnapshots;
+    return std::shared_ptr<BufferSnapshot>(new BufferSnapshot(memObject, size, temporaryFile,
+                                                              Hasher::hash(hostPtr, size)));
+}
+
+#ifdef CL_VERSION_1_2
+std::shared_ptr<BufferSnapshot> Logger::pendStream(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                   char* chunks[2], cl_uint numEvents, const cl_event* waitList)
+{
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+    PendingStream* stream = new PendingStream();
+    stream->chunks[0] = chunks[0];
+    stream->chunks[1] = chunks[1];
+    stream->chunkSize = snapshotChunkSize;
+
+    // The snapshot cleans up after a failure from here on
+    uc.clRetainMemObjectU(memObject);
+    std::shared_ptr<BufferSnapshot> snapshot(new BufferSnapshot(memObject, size, stream, &snapshotPool));
+
+    cl_int success = uc.clGetCommandQueueInfoU(queue, CL_QUEUE_CONTEXT, sizeof(cl_context),
+                                               &(stream->context), NULL);
+    if (success == CL_SUCCESS)
+        success = uc.clGetCommandQueueInfoU(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &(stream->device), NULL);
+    // Everything the kernel would see has been done once the marker completes
+    if (success == CL_SUCCESS)
+        success = uc.clEnqueueMarkerWithWaitListU(queue, numEvents, waitList, &(stream->after));
+
+    cl_event kernelGo = NULL;
+    if (success == CL_SUCCESS)
+        kernelGo = uc.clCreateUserEventU(stream->context, &success);
+    if (success != CL_SUCCESS)
+    {
+        ERROR_MSG("Failed to set up streaming buffer " << memObject << " for snapshot (" << success << ")");
+        return std::shared_ptr<BufferSnapshot>();
+    }
+
+    snapshot->readEvent = kernelGo;
+    return snapshot;
+}
+#endif
+
+bool Logger::streamSnapshot(BufferSnapshot& snapshot)
+{
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+    PendingStream& stream = *snapshot.stream;
+
+    cl_command_queue queue = drainQueue(stream.context, stream.device);
+    if (queue == NULL)
+    {
+        snapshot.releaseStream();
+        return false;
+    }
 
-#else
+    std::string temporaryFile = newTemporaryFile();
+    std::ofstream file(temporaryFile.c_str(), std::ios::out | std::ios::binary);
 
-#include <inttypes.h>
-#include <Windows.h>
-#define MKDIR_FAILS(d)     (CreateDirectory(d, NULL) == 0)
-#define DIR_ALREADY_EXISTS (GetLastError() == ERROR_ALREADY_EXISTS)
+    // Chunk ``index`` is read into chunks[index % 2] and reads[index % 2]
+    // says when it has arrived
+    cl_event reads[2] = { NULL, NULL };
+    size_t numChunks = (snapshot.size + stream.chunkSize - 1) / stream.chunkSize;
+    Hasher hasher;
 
-static void checkDirectoryExists(const char* dirName) {
-    DWORD ftyp = GetFileAttributesA(dirName);
-    if ((ftyp != INVALID_FILE_ATTRIBUTES) && ftyp & FILE_ATTRIBUTE_DIRECTORY)
-        return;
-    ERROR_MSG(strerror(errno) << ". Directory was :" << dirName);
-    exit(1);
-}
+    cl_int success = CL_SUCCESS;
+    for (size_t index = 0; index <= numChunks && success == CL_SUCCESS && file.good(); ++index)
+    {
+        if (index < numChunks)
+        {
+            size_t offset = index * stream.chunkSize;
+            success = uc.clEnqueueReadBufferU(queue,
+                                              snapshot.memObject,
+                                              CL_FALSE,
+                                              offset,
+                                              std::min(stream.chunkSize, snapshot.size - offset),
+                                              stream.chunks[index % 2],
+                                              1,
+                                              &(stream.after),
+                                              &(reads[index % 2]));
+            if (success != CL_SUCCESS)
+                break;
+        }
 
+        // Write out the previous chunk while this one is read
+        if (index == 0)
+            continue;
+
+        size_t previous = index - 1;
+        cl_event& read = reads[previous % 2];
+        success = uc.clWaitForEventsU(1, &read);
+        uc.clReleaseEventU(read);
+        read = NULL;
+        if (success != CL_SUCCESS)
+            break;
+
+#ifdef CL_VERSION_1_2
+        // The kernel can run as soon as all of the buffer has been read
+        if (index == numChunks)
+        {
+            uc.clSetUserEventStatusU(snapshot.readEvent, CL_COMPLETE);
+            stream.completed = true;
+        }
 #endif
 
-using namespace std;
-using namespace gvki;
+        size_t offset = previous * stream.chunkSize;
+        size_t length = std::min(stream.chunkSize, snapshot.size - offset);
+        hasher.update(stream.chunks[previous % 2], length);
+        file.write(stream.chunks[previous % 2], length);
+    }
 
-// Maximum number of files or directories
-// that can be created
-static const int maxFiles = 10000;
+    // Don't give the chunks back while they are still being read into
+    for (unsigned index = 0; index < 2; ++index)
+    {
+        if (reads[index] != NULL)
+        {
+            uc.clWaitForEventsU(1, &(reads[index]));
+            uc.clReleaseEventU(reads[index]);
+        }
+    }
+    snapshot.releaseStream();
 
-Logger& Logger::Singleton()
-{
-    static Logger l;
-    return l;
+    file.close();
+    if (success != CL_SUCCESS || !file.good())
+    {
+        ERROR_MSG("Failed to stream buffer " << snapshot.memObject << " to \"" << temporaryFile
+                  << "\" for snapshot (" << success << ")");
+        remove(temporaryFile.c_str());
+        return false;
+    }
+
+    snapshot.temporaryFile = temporaryFile;
+    snapshot.hashed = true;
+    snapshot.contents = hasher.finish();
+    ++streamedSnapshots;
+    return true;
 }
 
-Logger::Logger()
+std::shared_ptr<BufferSnapshot> Logger::takeSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                     cl_uint numEvents, const cl_event* waitList)
 {
-    arrayDataCounter = 0;
+    if (shadowSnapshots)
+    {
+        std::shared_ptr<BufferSnapshot> snapshot = shadowSnapshot(queue, memObject, size, numEvents, waitList);
+        if (snapshot != NULL)
+            return snapshot;
 
-    // FIXME: Reading from the environment probably doesn't belong in here
-    // but it makes implementing the singleton a lot easier
-    const char* doNotUseNumberedDirs = getenv("GVKI_NO_NUM_DIRS");
-    if (doNotUseNumberedDirs)
+        ++shadowFallbacks;
+    }
+
+    return readSnapshot(queue, memObject, size, !asyncSnapshots, numEvents, waitList);
+}
+
+std::shared_ptr<BufferSnapshot> Logger::readSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                     bool blocking, cl_uint numEvents, const cl_event* waitList)
+{
+#ifdef CL_VERSION_1_2
+    // Without memory for the chunks the whole
+    // buffer is read into a mapped file instead
+    if (size > snapshotChunkSize)
     {
-        DEBUG_MSG("Using manual directory");
-        const char* rootDir = getenv("GVKI_ROOT");
-        if (!rootDir)
+        char* chunks[2] = { snapshotPool.allocate(snapshotChunkSize), snapshotPool.allocate(snapshotChunkSize) };
+        if (chunks[0] != NULL && chunks[1] != NULL)
+            return pendStream(queue, memObject, size, chunks, numEvents, waitList);
+
+        for (unsigned index = 0; index < 2; ++index)
         {
-            ERROR_MSG("If using GVKI_NO_NUM_DIRS then GVKI_ROOT must be specified");
-            _exit(1);
+            if (chunks[index] != NULL)
+                snapshotPool.release(chunks[index], snapshotChunkSize);
         }
-        initDirectoryManual(rootDir);
     }
-    else
+#endif
+
+    std::shared_ptr<BufferSnapshot> snapshot = newSnapshot(memObject, size);
+    if (snapshot == NULL)
+        return snapshot;
+
+    cl_int success = UnderlyingCaller::Singleton().clEnqueueReadBufferU(
+                        queue,
+                        memObject,
+                        blocking ? CL_TRUE : CL_FALSE,
+                        0,
+                        size,
+                        snapshot->data,
+                        numEvents,
+                        waitList,
+                        blocking ? NULL : &(snapshot->readEvent));
+    if (success != CL_SUCCESS)
     {
-        DEBUG_MSG("Using numbered directory");
-        initDirectoryNumbered();
+        ERROR_MSG("Failed to read buffer " << memObject << " for snapshot (" << success << ")");
+        return std::shared_ptr<BufferSnapshot>();
     }
-    checkDirectoryExists(this->directory.c_str());
-    DEBUG_MSG("Directory used for logging is \"" << this->directory << "\"");
 
-    openLog();
+    return snapshot;
 }
 
-void Logger::initDirectoryManual(const char* rootDir)
+std::shared_ptr<BufferSnapshot> Logger::shadowSnapshot(cl_command_queue queue, cl_mem memObject, size_t size,
+                                                       cl_uint numEvents, const cl_event* waitList)
 {
-    assert(rootDir && "rootDir cannot be NULL");
+    UnderlyingCaller& uc = UnderlyingCaller::Singleton();
+    if (!shadowMemory.reserve(size))
+        return std::shared_ptr<BufferSnapshot>();
+
+    cl_context context = NULL;
+    cl_device_id device = NULL;
+    cl_mem shadow = NULL;
+    cl_int success = uc.clGetCommandQueueInfoU(queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL);
+    if (success == CL_SUCCESS)
+        success = uc.clGetCommandQueueInfoU(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+    if (success == CL_SUCCESS)
+        shadow = uc.clCreateBufferU(context, CL_MEM_READ_WRITE, size, NULL, &success);
+
+    if (success != CL_SUCCESS)
+    {
+        DEBUG_MSG("Could not create a device copy of buffer " << memObject << " (" << success << ")");
+        shadowMemory.release(size);
+        return std::shared_ptr<BufferSnapshot>();
+    }
 
-    if (MKDIR_FAILS(rootDir))
+    // The shadow is released with the snapshot if the copy fails
+    std::shared_ptr<BufferSnapshot> snapshot(new BufferSnapshot(memObject, size, shadow, context,
+                                                                device, &shadowMemory));
+    success = uc.clEnqueueCopyBufferU(queue, memObject, shadow, 0, 0, size,
+                                      numEvents, waitList, &(snapshot->readEvent));
+    if (success != CL_SUCCESS)
     {
-        ERROR_MSG("Failed to create directory \"" << rootDir << ": " << strerror(errno));
-        _exit(1);
+        DEBUG_MSG("Could not copy buffer " << memObject << " on the device (" << success << ")");
+        return std::shared_ptr<BufferSnapshot>();
     }
-    this->directory = std::string(rootDir);
+
+    ++shadowedSnapshots;
+    return snapshot;
 }
 
-void Logger::initDirectoryNumbered()
+bool Logger::drainShadow(BufferSnapshot& snapshot)
 {
-    int count = 0;
-    bool success= false;
+    std::shared_ptr<BufferSnapshot> copy;
+    if (cl_command_queue queue = drainQueue(snapshot.shadowContext, snapshot.shadowDevice))
+        copy = readSnapshot(queue, snapshot.shadow, snapshot.size, /*blocking=*/true, 0, NULL);
+    // Big copies are streamed, which we have to do ourselves here
+    if (copy != NULL && copy->stream != NULL && !streamSnapshot(*copy))
+        copy.reset();
+
+    snapshot.releaseShadow();
+    if (copy == NULL)
+        return false;
+
+    snapshot.swapContents(*copy);
+    return true;
+}
 
-    std::string directoryPrefix;
+cl_command_queue Logger::drainQueue(cl_context context, cl_device_id device)
+{
+    cl_command_queue& queue = drainQueues[std::make_pair(context, device)];
+    if (queue != NULL)
+        return queue;
 
-    const char* envTemp = getenv("GVKI_ROOT");
-    if (envTemp)
+    cl_int success = CL_SUCCESS;
+    queue = UnderlyingCaller::Singleton().clCreateCommandQueueU(context, device, 0, &success);
+    if (success != CL_SUCCESS)
     {
-        DEBUG_MSG("Using GVKI_ROOT value as destination for directories");
-
-        checkDirectoryExists(envTemp);
-
-        directoryPrefix = envTemp;
-
+        ERROR_MSG("Failed to create a queue to read back device copies of buffers (" << success << ")");
+        queue = NULL;
     }
-    else
+    return queue;
+}
+
+void Logger::releaseDrainQueues()
+{
+    for (DrainQueueMap::const_iterator b = drainQueues.begin(), e = drainQueues.end(); b != e; ++b)
     {
-        // Use the current working directory
-        DEBUG_MSG("Using current working directory as destination for directories");
+        if (b->second != NULL)
+            UnderlyingCaller::Singleton().clReleaseCommandQueueU(b->second);
+    }
+    drainQueues.clear();
+}
 
-        // FIXME: Hard-coding this size is gross
-        #define MAX_DIR_LENGTH 1024
+void Logger::writeRecords()
+{
+    InvocationRecord* record;
+    while (pendingRecords.pop(record))
+    {
+        write(*record);
+        delete record;
 
-#ifndef _WIN32
-        char cwdArray[MAX_DIR_LENGTH];
-        char* cwdResult = getcwd(cwdArray, sizeof(cwdArray)/sizeof(char));
-        if (!cwdResult)
-#else
-        char cwdResult[MAX_DIR_LENGTH];
-        if (GetCurrentDirectory(MAX_DIR_LENGTH, cwdResult) == 0)
-#endif
+        // Only touch the file when we've caught up so a busy
+        // application doesn't cost a write per record.
+        if (pendingRecords.empty())
         {
-            ERROR_MSG(strerror(errno) << ". Could not read the current working directory");
-            exit(1);
+            output->flush();
+            releaseDrainQueues();
         }
-        else
-            directoryPrefix = cwdResult;
     }
-    directoryPrefix += PATH_SEP "gvki";
-    DEBUG_MSG("Directory prefix is \"" << directoryPrefix << "\"");
+    releaseDrainQueues();
+}
 
-    // Keep trying a directoryPrefix name with a number as suffix
-    // until we find an available one or we exhaust the maximum
-    // allowed number
-    while (count < maxFiles)
+void Logger::write(InvocationRecord& record)
+{
+    // The snapshots are named after their contents so they
+    // have to be complete before the record can be written.
+    std::vector<BufferSnapshot*> snapshots = record.snapshots();
+    for (unsigned index=0; index < snapshots.size(); ++index)
     {
-        stringstream ss;
-        ss <<  directoryPrefix << "-" << count;
-        ++count;
+        BufferSnapshot& snapshot = *snapshots[index];
 
-        // Make the directoryPrefix
-        if (MKDIR_FAILS(ss.str().c_str()))
+        // Already written for an earlier record
+        if (!snapshot.fileName.empty())
+            continue;
+
+        // This completes readEvent so it must come first
+        if (snapshot.stream != NULL)
+            streamSnapshot(snapshot);
+
+        if (snapshot.readEvent != NULL)
         {
-            if (!DIR_ALREADY_EXISTS)
+            cl_int status = UnderlyingCaller::Singleton().clWaitForEventsU(1, &(snapshot.readEvent));
+            if (status != CL_SUCCESS)
             {
-                ERROR_MSG(strerror(errno) << ". Directory was :" << directoryPrefix);
-                exit(1);
+                ERROR_MSG("Snapshot read for buffer " << snapshot.memObject << " failed (" << status << ")");
+                continue;
             }
+        }
 
-            // It already exists, try again
+        if (snapshot.shadow != NULL && !drainShadow(snapshot))
+            continue;
+
+        // A stream or shadow copy that failed, here or for an earlier record
+        if (snapshot.data == NULL && !snapshot.hashed)
+            continue;
+
+        // Identical data (e.g. weights or lookup tables passed to many
+        // kernels) is only written once.
+        Hash128 contents = snapshot.hashed ? snapshot.contents : Hasher::hash(snapshot.data, snapshot.size);
+        snapshot.fileName = "array_data_" + contents.toHex() + ".bin";
+        if (writtenSnapshots.count(contents) != 0)
+            ++duplicateSnapshots;
+        else if (writeSnapshot(snapshot))
+            writtenSnapshots.insert(contents);
+        else
+        {
+            // The record is written without it. The data is kept
+            // so a later record using the snapshot can try again.
+            snapshot.fileName.clear();
             continue;
         }
 
-        this->directory = ss.str();
-        success = true;
-        break;
+        // Later records reusing the snapshot only need its name
+        snapshot.releaseData();
     }
 
-    if (!success)
+    if (record.heldJSON)
     {
-        ERROR_MSG("Exhausted available directory names or couldn't create any");
-        exit(1);
+        output->beginCapture(*record.heldJSON);
+        dump(record);
+        output->endCapture();
+    }
+    else
+    {
+        separateRecord();
+        dump(record);
     }
-
 }
 
-
-void Logger::openLog()
+bool Logger::writeSnapshot(BufferSnapshot& snapshot)
 {
-    // FIXME: We should use mkstemp() or something
-    std::stringstream ss;
-    ss << directory << PATH_SEP << "log.json";
-    output = new std::ofstream(ss.str().c_str(), std::ofstream::out | std::ofstream::ate);
+    std::string withDir = (directory + PATH_SEP) + snapshot.fileName;
 
-    if (! output->good())
+    // The data is already in a file, it just needs the right name
+    if (!snapshot.temporaryFile.empty() &&
+        rename(snapshot.temporaryFile.c_str(), withDir.c_str()) == 0)
     {
-        ERROR_MSG("Failed to create file (" << ss.str() <<  ") to write log to");
-        exit(1);
+        snapshot.temporaryFile.clear();
+        return true;
     }
 
-    // Start of JSON array
-    *output << "[" << std::endl;
-}
-
-void Logger::closeLog()
-{
-    assert(output != NULL && "output must not be NULL");
-    // End of JSON array
-    *output << std::endl << "]" << std::endl;
-    output->close();
-}
+    if (snapshot.data == NULL)
+    {
+        ERROR_MSG("Failed to rename \"" << snapshot.temporaryFile << "\" to \"" << withDir << "\"");
+        return false;
+    }
 
-Logger::~Logger()
-{
-    closeLog();
-    delete output;
-}
+    std::ofstream dataOutputStream;
+    dataOutputStream.open(withDir.c_str(), std::ios::out | std::ios::binary);
+    if (dataOutputStream.good())
+        dataOutputStream.write(snapshot.data, snapshot.size);
+    dataOutputStream.close();
 
-int cl_error_check(cl_int err, const char *err_string) {
-  if (err == CL_SUCCESS)
-    return 0;
-  printf("%s: %d\n", err_string, err);
-  return 1;
+    if (!dataOutputStream.good())
+    {
+        ERROR_MSG("Failed to write snapshot of buffer " << snapshot.memObject << " to \"" << withDir << "\"");
+        remove(withDir.c_str());
+        return false;
+    }
+    return true;
 }
 
-void Logger::dump(cl_kernel k)
+void Logger::dump(InvocationRecord& record)
 {
     // Output JSON format defined by
     // http://multicore.doc.ic.ac.uk/tools/GPUVerify/docs/json_format.html
-    KernelInfo& ki = kernels[k];
-    assert( programs.count(ki.program) == 1 && "cl_program missing");
-    ProgramInfo& pi = programs[ki.program];
+    ProgramInfo& pi = record.program;
 
-    static bool isFirst = true;
+    *output << "{\n\"language\": \"OpenCL\",\n";
 
-    if (!isFirst)
-    {
-        // Emit array element seperator
-        // to seperate from previous dump
-        *output << "," << endl;
-    }
-    isFirst = false;
-
-    *output << "{" << endl << "\"language\": \"OpenCL\"," << endl;
-
-    std::string kernelSourceFile = dumpKernelSource(ki);
-    
-    // Getting the device
-    cl_device_id *devices = (cl_device_id *) calloc(10, sizeof(cl_device_id));
-    
-    cl_program *program = (cl_program *) calloc(1, sizeof(cl_program));
-    size_t *size_p = (size_t *) calloc(1, sizeof(size_t));
-    
-    cl_int p =  clGetKernelInfo (k,
-  	CL_KERNEL_PROGRAM,
-  	sizeof(cl_program),
-  	program,
-  	size_p);
-    assert(p == CL_SUCCESS);
-    assert(program != NULL);
-    
-    *size_p = 0;
-    
-    cl_int info = clGetProgramInfo (*program,
-  	CL_PROGRAM_DEVICES,
-  	10 * sizeof(cl_device_id),
-  	devices,
-  	size_p);
-    
-    assert(info == CL_SUCCESS);
-    assert(devices != NULL);
-
-    printf("devices = %p", *devices);
-    
-    //assert(*devices != NULL && "no device found");
-    //assert(*(devices + sizeof(cl_device_id)) == NULL && "multiple devices found");
-    
-    cl_bool result;
-    size_t *size = (size_t *) calloc(8, 1);
-    
-    cl_int isLE = clGetDeviceInfo(devices[0],
-  	CL_DEVICE_ENDIAN_LITTLE,
-  	8,
-  	&result,
-  	size);
-    assert(isLE == CL_SUCCESS);
-
-    const char *endian = result ? "little": "big";
-    
-    *output << "\"endianness\": \"" << endian << "\"," << endl;
-    
-    
-    *output << "\"kernel_file\": \"" << kernelSourceFile << "\"," << endl;
+    std::string kernelSourceFile = dumpKernelSource(record);
+
+    // FIXME: We assume little endian if we don't know the device
+    bool littleEndian = (record.device == NULL) || record.device->littleEndian;
+    *output << "\"endianness\": \"" << (littleEndian ? "little" : "big") << "\",\n";
+
+    // The device's properties are in devices.json
+    if (record.device != NULL)
+        *output << "\"device\": " << record.device->id << ",\n";
+
+    *output << "\"kernel_file\": \"" << kernelSourceFile << "\",\n";
 
     // FIXME: Teach GPUVerify how to handle non zero global_offset
     // FIXME: Document this json attribute!
     // Only emit global_offset if its non zero
     bool hasNonZeroGlobalOffset = false;
-    for (unsigned index=0; index < ki.globalWorkOffset.size() ; ++index)
+    for (unsigned index=0; index < record.globalWorkOffset.size() ; ++index)
     {
-        if (ki.globalWorkOffset[index] != 0)
+        if (record.globalWorkOffset[index] != 0)
             hasNonZeroGlobalOffset = true;
     }
     if (hasNonZeroGlobalOffset)
     {
         *output << "\"global_offset\": ";
-        printJSONArray(ki.globalWorkOffset);
-        *output << "," << endl;
+        printJSONArray(record.globalWorkOffset);
+        *output << ",\n";
     }
 
     *output << "\"global_size\": ";
-    printJSONArray(ki.globalWorkSize);
-    *output << "," << endl;
+    printJSONArray(record.globalWorkSize);
+    *output << ",\n";
 
     // Note if local_size is unconstrained
     // we just don't emit the ``local_size`` key or its value.
-    if (!ki.localWorkSizeIsUnconstrained)
+    if (!record.localWorkSizeIsUnconstrained)
     {
         *output << "\"local_size\": ";
-        printJSONArray(ki.localWorkSize);
-        *output << "," << endl;
+        printJSONArray(record.localWorkSize);
+        *output << ",\n";
     }
 
-    *output << "\"compiler_flags\": \"" << pi.compileFlags << "\"," << endl;
+    *output << "\"compiler_flags\": \"" << pi.compileFlags << "\",\n";
 
-    assert( (ki.globalWorkOffset.size() == ki.globalWorkSize.size()) &&
-            (ki.globalWorkSize.size() == ki.localWorkSize.size()) &&
+    assert( (record.globalWorkOffset.size() == record.globalWorkSize.size()) &&
+            (record.globalWorkSize.size() == record.localWorkSize.size()) &&
             "dimension mismatch");
 
     // Emit information about host code API calls used to build the kernel
     // and enqueue it if available
-    if (pi.hasHostCodeInfo() || ki.hasHostCodeInfo())
+    if (pi.hasHostCodeInfo() || record.kernelCall.hasHostCodeInfo())
     {
-        *output << "\"host_api_calls\": [" << endl;
+        *output << "\"host_api_calls\": [\n";
         bool mightNeedComma = false;
 
         if (pi.hasHostCodeInfo())
@@ -336,45 +1644,56 @@ void Logger::dump(cl_kernel k)
             mightNeedComma = true;
         }
 
-        if (ki.hasHostCodeInfo())
+        if (record.kernelCall.hasHostCodeInfo())
         {
             if (mightNeedComma)
-                *output << "," << endl;
+                *output << ",\n";
 
-            printJSONHostCodeInvocationInfo(ki);
+            printJSONHostCodeInvocationInfo(record.kernelCall);
         }
 
-        *output << "]," << endl;
+        *output << "],\n";
     }
 
-    *output << "\"entry_point\": \"" << ki.entryPointName << "\"";
+    *output << "\"entry_point\": \"" << record.entryPointName << "\"";
 
 
     // entry_point might be the last entry is there were no kernel args
-    if (ki.arguments.size() == 0)
-        *output << endl;
+    if (record.arguments.size() == 0)
+        *output << '\n';
     else
     {
-        *output << "," << endl << "\"kernel_arguments\": [" << endl;
-        for (unsigned argIndex=0; argIndex < ki.arguments.size() ; ++argIndex)
+        *output << ",\n\"kernel_arguments\": [\n";
+        for (unsigned argIndex=0; argIndex < record.arguments.size() ; ++argIndex)
         {
-            printJSONKernelArgumentInfo(ki.arguments[argIndex]);
-            if (argIndex != (ki.arguments.size() -1))
-                *output << "," << endl;
+            printJSONKernelArgumentInfo(record.arguments[argIndex]);
+            if (argIndex != (record.arguments.size() -1))
+                *output << ",\n";
         }
-        *output << endl << "]" << endl;
+        *output << "\n]\n";
     }
 
 
     *output << "}";
 }
 
+void Logger::separateRecord()
+{
+    if (!firstRecord)
+    {
+        // Emit array element seperator
+        // to seperate from previous dump
+        *output << ",\n";
+    }
+    firstRecord = false;
+}
+
 void Logger::printJSONHostCodeInvocationInfo(HostAPICallInfo& info)
 {
     assert(info.hasHostCodeInfo() && "no host code info available");
-    *output << "{" << endl << "\"function_name\": \"" << info.hostCodeFunctionCalled << "\"," << endl <<
-               "\"compilation_unit\": \"" << info.compilationUnit << "\"," << endl <<
-               "\"line_number\": " << info.lineNumber << endl << "}" << endl;
+    *output << "{\n\"function_name\": \"" << info.hostCodeFunctionCalled << "\",\n" <<
+               "\"compilation_unit\": \"" << info.compilationUnit << "\",\n" <<
+               "\"line_number\": " << info.lineNumber << "\n}\n";
 }
 
 void Logger::printJSONArray(std::vector<size_t>& array)
@@ -390,7 +1709,31 @@ void Logger::printJSONArray(std::vector<size_t>& array)
     *output << "]";
 }
 
-BufferInfo * Logger::tryGetBuffer(ArgInfo& ai) {
+uint64_t Logger::objectGeneration(ArgInfo::Declaration declaration, const void* argValue, size_t argSize) {
+
+    if (argValue == NULL || argSize != sizeof(cl_mem))
+    {
+        return 0;
+    }
+
+    cl_mem mightBecl_mem = *((const cl_mem*) argValue);
+
+    // If the implementation told us what the argument is
+    // there's only one place to look
+    switch (declaration)
+    {
+        case ArgInfo::BUFFER:
+            return buffers.generation(mightBecl_mem);
+        case ArgInfo::IMAGE:
+            return images.generation(mightBecl_mem);
+        case ArgInfo::SAMPLER:
+            return samplers.generation(*((const cl_sampler*) argValue));
+        case ArgInfo::LOCAL:
+        case ArgInfo::VALUE:
+            return 0;
+        case ArgInfo::UNKNOWN:
+            break;
+    }
 
     // Hack:
     // It's hard to determine what type the argument is.
@@ -400,235 +1743,246 @@ BufferInfo * Logger::tryGetBuffer(ArgInfo& ai) {
     // In some implementations cl_mem will be a pointer
     // which poses a risk if a scalar parameter of the same size
     // as the pointer type.
+    //
+    // This is done when the argument is set rather than when the kernel is
+    // enqueued so a scalar can't be mistaken for an object created in
+    // between that happens to have been given the same handle.
 
-    if (ai.argSize != sizeof(cl_mem))
-    {
-        return NULL;
-    }
+    // We might be reading invalid data now. If it's a cl_mem
+    // we saw before we're going to assume that's what it is.
+    if (uint64_t generation = buffers.generation(mightBecl_mem))
+        return generation;
 
-    cl_mem mightBecl_mem = *((cl_mem*)ai.argValue);
+    if (uint64_t generation = images.generation(mightBecl_mem))
+        return generation;
 
-    // We might be reading invalid data now
-    if (buffers.count(mightBecl_mem) != 1)
+    // Hack: a similar hack for the samplers
+    if (argSize == sizeof(cl_sampler))
     {
-        return NULL;
+        cl_sampler mightBecl_sampler = *((const cl_sampler*) argValue);
+        return samplers.generation(mightBecl_sampler);
     }
 
-    // We're going to assume it's cl_mem that we saw before
-    return &buffers[mightBecl_mem];
+    return 0;
+}
+
+bool Logger::tryGetBuffer(const ArgInfo& ai, const void* argValue, BufferInfo& bi) {
+    if (ai.generation == 0)
+        return false;
+
+    return buffers.lookup(*((const cl_mem*) argValue), ai.generation, bi);
 }
 
-void Logger::printJSONKernelArgumentInfo(ArgInfo& ai)
+void Logger::recordArgument(const ArgInfo& ai, const void* argValue, ArgRecord& ar)
 {
-    *output << "{";
-    if (ai.argValue == NULL)
+    ar.size = ai.argSize;
+    ar.declaration = ai.declaration;
+
+    if (argValue == NULL)
     {
         // NULL was passed to clSetKernelArg()
         // That implies its for unallocated memory
-        *output << "\"type\": \"array\",";
-
-        // If the arg is for local memory
-        if (ai.argSize != sizeof(cl_mem) && ai.argSize != sizeof(cl_sampler))
-        {
-            // We assume this means this arguments is for local memory
-            // where size actually means the sizeof the underlying buffer
-            // rather than the size of the type.
-            *output << "\"size\" : " << ai.argSize;
-        }
-        *output << "}";
+        ar.kind = ArgRecord::UNALLOCATED;
         return;
     }
 
-    // FIXME:
-    // Eurgh... the spec says
+    // The spec says
     // ```
     // If the argument is a buffer object, the arg_value pointer can be NULL or
     // point to a NULL value in which case a NULL value will be used as the
     // value for the argument declared as a pointer to __global or __constant
     // memory in the kernel.  ```
     //
-    // This makes it impossible (seeing as we don't know which address space
-    // the arguments are in) to work out the argument type once derefencing the
-    // pointer and finding it's equal zero because it could be a scalar constant
-    // (of value 0) or it could be an unintialised array!
-
-    if (BufferInfo * bi = tryGetBuffer(ai))
+    // If we know the declaration we can tell that apart from a scalar of
+    // value 0. Otherwise (FIXME) it is logged as a scalar.
+    if (ai.declaration == ArgInfo::BUFFER && ai.argSize == sizeof(cl_mem) &&
+        *((const cl_mem*) argValue) == NULL)
     {
-        *output << "\"type\": \"array\", ";
-
-        *output << "\"size\": " << bi->size << ", ";
-
-        *output << "\"flags\": \"";
-        switch (bi->flags)
-        {
-            case CL_MEM_READ_ONLY:
-                *output << "CL_MEM_READ_ONLY";
-                break;
-            case CL_MEM_WRITE_ONLY:
-                *output << "CL_MEM_WRITE_ONLY";
-                break;
-            case CL_MEM_READ_WRITE:
-                *output << "CL_MEM_READ_WRITE";
-                break;
-            default:
-                *output << "UNKNOWN";
-        }
-        *output << "\"";
-
-        if (bi->data != NULL)
-        {
-            std::stringstream dataFileName;
-            dataFileName << "array_data_" << arrayDataCounter << ".bin";
-            arrayDataCounter++;
-            *output << ", \"data\": \"" << dataFileName.str() << "\"";
-
-            std::string withDir = (directory + PATH_SEP) + dataFileName.str();
-            std::ofstream dataOutputStream;
-            dataOutputStream.open(withDir.c_str(), std::ios::out | std::ios::binary);
-            if (dataOutputStream.good())
-            {
-                dataOutputStream.write((const char*)(bi->data), bi->size);
-            }
-            else
-            {
-                // TODO: work out best course of action for handling exception here
-            }
-            dataOutputStream.close();
-        }
-
-        *output << "}";
-
+        ar.kind = ArgRecord::UNALLOCATED;
         return;
-
     }
 
-    // Hack: a similar hack of the image types
-    if (ai.argSize == sizeof(cl_mem))
+    // Objects are only looked up under the generation they had when the
+    // argument was set so we never use information about an object that
+    // has since been destroyed and its handle given to another one.
+    BufferInfo bi;
+    if (tryGetBuffer(ai, argValue, bi))
     {
-       cl_mem mightBecl_mem = *((cl_mem*) ai.argValue);
-
-       // We might be reading invalid data now
-       if (images.count(mightBecl_mem) == 1)
-       {
-           // We're going to assume it's cl_mem that we saw before
-           *output << "\"type\": \"image\"}";
-           return;
-       }
-
+        ar.kind = ArgRecord::ARRAY;
+        ar.size = bi.size;
+        ar.flags = bi.flags;
+        return;
     }
 
-    // Hack: a similar hack for the samplers
-    if (ai.argSize == sizeof(cl_sampler))
+    ImageInfo ii;
+    if (ai.generation != 0 && images.lookup(*((const cl_mem*) argValue), ai.generation, ii))
     {
-       cl_sampler mightBecl_sampler = *((cl_sampler*) ai.argValue);
+        ar.kind = ArgRecord::IMAGE;
+        return;
+    }
 
-       // We might be reading invalid data now
-       if (samplers.count(mightBecl_sampler) == 1)
-       {
-           // We're going to assume it's cl_mem that we saw before
-           *output << "\"type\": \"sampler\"}";
-           return;
-       }
+    SamplerInfo si;
+    if (ai.generation != 0 && samplers.lookup(*((const cl_sampler*) argValue), ai.generation, si))
+    {
+        ar.kind = ArgRecord::SAMPLER;
+        return;
+    }
 
+    if (ai.generation != 0)
+    {
+        ERROR_MSG("Kernel argument refers to a memory object or sampler that has been released. Logging it as a scalar");
     }
 
     // I guess it's scalar???
-    *output << "\"type\": \"scalar\",";
-    *output << " \"value\": \"0x";
-    // Print the value as hex
-    uint8_t* asByte = (uint8_t*) ai.argValue;
-    // We assume the host is little endian so to print the values
-    // we need to go through the array bytes backwards
-    for (int byteIndex= ai.argSize -1; byteIndex >=0 ; --byteIndex)
+    ar.kind = ArgRecord::SCALAR;
+    const unsigned char* asByte = (const unsigned char*) argValue;
+    ar.value.assign(asByte, asByte + ai.argSize);
+}
+
+void Logger::printJSONKernelArgumentInfo(ArgRecord& ar)
+{
+    *output << "{";
+    switch (ar.kind)
     {
-       *output << std::hex << std::setfill('0') << std::setw(2) << ( (unsigned) asByte[byteIndex]);
-    }
-    *output << "\"" << std::dec; //std::hex is sticky so switch back to decimal
+        case ArgRecord::UNALLOCATED:
+            *output << "\"type\": \"array\"";
+
+            // For local memory the size is how much to allocate rather
+            // than the size of the type. Without the declaration we
+            // assume sizes that can't be handles are local memory.
+            if (ar.declaration == ArgInfo::LOCAL ||
+                (ar.declaration == ArgInfo::UNKNOWN && ar.size != sizeof(cl_mem) && ar.size != sizeof(cl_sampler)))
+            {
+                *output << ", \"size\": " << ar.size;
+            }
+            break;
 
-    *output << "}";
-    return;
+        case ArgRecord::ARRAY:
+            *output << "\"type\": \"array\", ";
 
-}
+            *output << "\"size\": " << ar.size << ", ";
 
-static bool file_exists(std::string& name) {
-	ifstream f(name.c_str());
-	bool result = f.good();
-	f.close();
-	return result;
+            *output << "\"flags\": \"";
+            switch (ar.flags & (CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE))
+            {
+                case CL_MEM_READ_ONLY:
+                    *output << "CL_MEM_READ_ONLY";
+                    break;
+                case CL_MEM_WRITE_ONLY:
+                    *output << "CL_MEM_WRITE_ONLY";
+                    break;
+                // Buffers are read/write unless they say otherwise
+                case 0:
+                case CL_MEM_READ_WRITE:
+                    *output << "CL_MEM_READ_WRITE";
+                    break;
+                default:
+                    *output << "UNKNOWN";
+            }
+            *output << "\"";
+
+            // There's no file if the snapshot's read failed
+            if (ar.snapshot != NULL && !ar.snapshot->fileName.empty())
+                *output << ", \"data\": \"" << ar.snapshot->fileName << "\"";
+            break;
+
+        case ArgRecord::IMAGE:
+            *output << "\"type\": \"image\"";
+            break;
+
+        case ArgRecord::SAMPLER:
+            *output << "\"type\": \"sampler\"";
+            break;
+
+        case ArgRecord::SCALAR:
+            *output << "\"type\": \"scalar\",";
+            *output << " \"value\": \"0x";
+            // We assume the host is little endian so to print the values
+            // we need to go through the array bytes backwards
+            if (!ar.value.empty())
+                output->writeHexReversed(&(ar.value[0]), ar.value.size());
+            *output << "\"";
+            break;
+    }
+    *output << "}";
 }
 
-// Define the strict weak ordering over ProgramInfo instances
-// Is this correct?
-bool ProgramInfoCacheCompare::operator() (const ProgramInfo& lhs, const ProgramInfo& rhs) const
+// Returns true if ``a`` and ``b`` would produce the same kernel file
+static bool sameSource(const ProgramSources& a, const ProgramSources& b)
 {
-    // Use the fact that a strict-weak order is already defined over std::vector<>
-    return lhs.sources < rhs.sources;
+    if (a == b)
+        return true;
+
+    // The same source might have been split up differently
+    std::string aConcat, bConcat;
+    for (unsigned index=0; index < a.size(); ++index)
+        aConcat += a[index];
+    for (unsigned index=0; index < b.size(); ++index)
+        bConcat += b[index];
+    return aConcat == bConcat;
 }
 
-std::string Logger::dumpKernelSource(KernelInfo& ki)
+std::string Logger::dumpKernelSource(InvocationRecord& record)
 {
-    ProgramInfo& pi = programs[ki.program];
+    ProgramInfo& pi = record.program;
 
     // See if we can used a file that we already printed.
     // This avoid writing duplicate files.
-    ProgCacheMapTy::iterator it = WrittenKernelFileCache.find(pi);
-    if ( it != WrittenKernelFileCache.end() )
+    // Only the hash is compared unless there is something in the same
+    // bucket that came from a different program.
+    std::vector<WrittenKernelFile>& bucket = WrittenKernelFileCache[pi.sourcesHash];
+    for (unsigned index=0; index < bucket.size(); ++index)
     {
-        return it->second;
+        if (bucket[index].sources == pi.sources || sameSource(*bucket[index].sources, *pi.sources))
+            return bucket[index].fileName;
     }
 
-
-    int count = 0;
-    bool success = false;
-    // FIXME: I really want a std::unique_ptr
-    std::ofstream* kos = 0;
+    // The logging directory starts off empty so the next free number
+    // for each entry point is known without looking at the directory.
+    // Files are created exclusively so if something else did create a
+    // file with the same name we just move on to the next number.
+    unsigned& next = nextKernelFileNumber[record.entryPointName];
+    FILE* kos = NULL;
     std::string theKernelPath;
-    while (count < maxFiles)
+    while (kos == NULL)
     {
         stringstream ss;
-        ss << ki.entryPointName << "." << count << ".cl";
-
-        ++count;
+        ss << record.entryPointName << "." << next << ".cl";
+        ++next;
 
         std::string withDir = (directory + PATH_SEP) + ss.str();
-        if (!file_exists(withDir))
+        int fd = CREATE_NEW_FILE(withDir.c_str());
+        if (fd == -1)
         {
-           // Use Binary mode to try avoid line ending issues on Windows
-           kos = new std::ofstream(withDir.c_str(), std::ofstream::binary);
-
-           if (!kos->good())
-           {
-                kos->close();
-                delete kos;
+            if (errno == EEXIST)
                 continue;
-           }
 
-           success = true;
-           theKernelPath = ss.str();
-           break;
+            ERROR_MSG(strerror(errno) << ". Failed to create kernel file \"" << withDir << "\"");
+            return std::string("FIXME");
         }
-    }
 
-    if (!success)
-    {
-        ERROR_MSG("Failed to log kernel output");
-        return std::string("FIXME");
+        kos = FD_TO_FILE(fd, "wb");
+        if (kos == NULL)
+        {
+            ERROR_MSG(strerror(errno) << ". Failed to open kernel file \"" << withDir << "\"");
+            CLOSE_FD(fd);
+            return std::string("FIXME");
+        }
+        theKernelPath = ss.str();
     }
 
     // Write kernel source
-
-    for (vector<string>::const_iterator b = pi.sources.begin(), e = pi.sources.end(); b != e; ++b)
+    for (vector<string>::const_iterator b = pi.sources->begin(), e = pi.sources->end(); b != e; ++b)
     {
-        *kos << *b;
+        fwrite(b->data(), 1, b->size(), kos);
     }
-
-    // Urgh this is bad, need RAII!
-    kos->close();
-    delete kos;
+    fclose(kos);
 
     // Store in cache
-    assert(WrittenKernelFileCache.count(pi) == 0 && "ProgramInfo already in cache!");
-    WrittenKernelFileCache[pi] = theKernelPath;
+    WrittenKernelFile written;
+    written.sources = pi.sources;
+    written.fileName = theKernelPath;
+    bucket.push_back(written);
 
     return theKernelPath;
 }
@@ -0,0 +1,191 @@
+#include "gvki/Sampler.h"
+#include "gvki/Logger.h"
+#include <cstdlib>
+#include <sstream>
+
+using namespace gvki;
+
+// Parse all of ``text`` as a whole number
+static bool parseCount(const std::string& text, uint64_t& value)
+{
+    char* end = NULL;
+    value = strtoull(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && text[0] != '-';
+}
+
+static bool parseReal(const std::string& text, double& value)
+{
+    char* end = NULL;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+Sampler::Sampler() : random(std::random_device()()), skippedLaunches(0)
+{
+    configure("once");
+}
+
+bool Sampler::configure(const std::string& spec)
+{
+    std::vector<Term> parsed;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        size_t equals = item.find('=');
+        std::string name = item.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : item.substr(equals + 1);
+        bool hasValue = equals != std::string::npos;
+
+        // A reservoir holds on to launches until the
+        // end so nothing can come after it
+        if (!parsed.empty() && parsed.back().kind == Term::RESERVOIR)
+            return false;
+
+        Term term;
+        term.count = 0;
+        term.probability = 0;
+        term.windowLaunches = 0;
+        if (name == "once" && !hasValue)
+            term.kind = Term::ONCE;
+        else if (name == "all" && !hasValue)
+            term.kind = Term::ALL;
+        else if (name == "every" && parseCount(value, term.count) && term.count > 0)
+            term.kind = Term::EVERY;
+        else if (name == "first" && parseCount(value, term.count))
+            term.kind = Term::FIRST;
+        else if (name == "reservoir" && parseCount(value, term.count) && term.count > 0)
+            term.kind = Term::RESERVOIR;
+        else if (name == "probability" && parseReal(value, term.probability) &&
+                 term.probability >= 0 && term.probability <= 1)
+            term.kind = Term::PROBABILITY;
+        else if (name == "rate")
+        {
+            // <launches>/<seconds>
+            size_t slash = value.find('/');
+            double seconds = 0;
+            if (slash == std::string::npos || !parseCount(value.substr(0, slash), term.count) ||
+                !parseReal(value.substr(slash + 1), seconds) || seconds <= 0)
+                return false;
+
+            term.kind = Term::RATE;
+            term.window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(seconds));
+            term.windowStart = std::chrono::steady_clock::now();
+        }
+        else
+            return false;
+
+        parsed.push_back(term);
+    }
+
+    if (parsed.empty())
+        return false;
+
+    terms.swap(parsed);
+    return true;
+}
+
+Sampler::EntryPoint* Sampler::entryPoint(const std::string& entryPointName)
+{
+    std::lock_guard<std::mutex> guard(entryPointsLock);
+    EntryPoint& ep = entryPoints[entryPointName];
+    ep.launches.resize(terms.size(), 0);
+    return &ep;
+}
+
+Sampler::Decision Sampler::decide(KernelInfo& ki, unsigned& slot)
+{
+    EntryPoint& ep = *ki.sampling;
+    for (unsigned index = 0; index < terms.size(); ++index)
+    {
+        Term& term = terms[index];
+        uint64_t launch = ++ep.launches[index];
+
+        bool keep = false;
+        switch (term.kind)
+        {
+            case Term::ONCE:
+                keep = !ki.loggedAlready;
+                break;
+            case Term::ALL:
+                keep = true;
+                break;
+            case Term::EVERY:
+                keep = (launch - 1) % term.count == 0;
+                break;
+            case Term::FIRST:
+                keep = launch <= term.count;
+                break;
+            case Term::PROBABILITY:
+                keep = std::uniform_real_distribution<double>(0, 1)(random) < term.probability;
+                break;
+            case Term::RATE:
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (now - term.windowStart >= term.window)
+                {
+                    term.windowStart = now;
+                    term.windowLaunches = 0;
+                }
+                keep = term.windowLaunches < term.count;
+                if (keep)
+                    ++term.windowLaunches;
+                break;
+            }
+            case Term::RESERVOIR:
+            {
+                // Algorithm R: the ``launch``th launch replaces
+                // a random slot with probability count / launch
+                uint64_t chosen = launch <= term.count ? launch - 1
+                                  : std::uniform_int_distribution<uint64_t>(0, launch - 1)(random);
+                if (chosen < term.count)
+                {
+                    slot = chosen;
+                    return HOLD;
+                }
+                break;
+            }
+        }
+
+        if (!keep)
+        {
+            ++skippedLaunches;
+            return SKIP;
+        }
+    }
+
+    return CAPTURE;
+}
+
+void Sampler::hold(KernelInfo& ki, unsigned slot, InvocationRecord* record)
+{
+    std::vector<std::shared_ptr<std::string> >& reservoir = ki.sampling->reservoir;
+    if (slot >= reservoir.size())
+        reservoir.resize(slot + 1);
+
+    // The replaced launch's buffer data may already have been written.
+    // It's left for the same data being logged again later.
+    if (reservoir[slot])
+        ++skippedLaunches;
+    record->heldJSON.reset(new std::string());
+    reservoir[slot] = record->heldJSON;
+}
+
+std::vector<std::shared_ptr<std::string> > Sampler::takeHeldRecords()
+{
+    std::vector<std::shared_ptr<std::string> > held;
+    std::lock_guard<std::mutex> guard(entryPointsLock);
+    for (std::unordered_map<std::string, EntryPoint>::iterator b = entryPoints.begin(), e = entryPoints.end();
+         b != e; ++b)
+    {
+        std::vector<std::shared_ptr<std::string> >& reservoir = b->second.reservoir;
+        for (unsigned slot = 0; slot < reservoir.size(); ++slot)
+        {
+            if (reservoir[slot])
+                held.push_back(reservoir[slot]);
+        }
+        reservoir.clear();
+    }
+    return held;
+}
@@ -0,0 +1,132 @@
+#include "gvki/SnapshotPool.h"
+#include <limits>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace gvki;
+
+// The smallest block handed out
+static const size_t MinimumBlockSize = 4096;
+
+// Blocks at least this big get their own mapping which can use
+// transparent huge pages, so reading into them faults less often
+static const size_t HugePageSize = 2 << 20;
+
+// Class ``index`` holds blocks of MinimumBlockSize << (index / 2),
+// one and a half times that for odd indices
+static size_t classSize(unsigned index)
+{
+    size_t size = MinimumBlockSize << (index / 2);
+    return (index % 2) ? size + size / 2 : size;
+}
+
+static unsigned sizeClass(size_t size)
+{
+    unsigned index = 0;
+    while (classSize(index) < size)
+        ++index;
+    return index;
+}
+
+static char* allocateBlock(size_t size)
+{
+#ifndef _WIN32
+    if (size >= HugePageSize)
+    {
+        void* block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(block, size, MADV_HUGEPAGE);
+#endif
+        return (char*) block;
+    }
+#endif
+    return new (std::nothrow) char[size];
+}
+
+static void freeBlock(char* block, size_t size)
+{
+#ifndef _WIN32
+    if (size >= HugePageSize)
+    {
+        munmap(block, size);
+        return;
+    }
+#endif
+    delete [] block;
+}
+
+SnapshotPool::SnapshotPool(MemoryBudget& budget) : budget(budget), allocated(0), reused(0)
+{
+}
+
+SnapshotPool::~SnapshotPool()
+{
+    freeUnused();
+}
+
+char* SnapshotPool::allocate(size_t size)
+{
+    // Too big for any class
+    if (size > std::numeric_limits<size_t>::max() / 4)
+        return NULL;
+
+    unsigned index = sizeClass(size);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (index < unused.size() && !unused[index].empty())
+        {
+            char* block = unused[index].back();
+            unused[index].pop_back();
+            ++reused;
+            return block;
+        }
+    }
+
+    // Blocks of other sizes might be taking up the budget
+    size_t blockSize = classSize(index);
+    if (!budget.reserve(blockSize))
+    {
+        freeUnused();
+        if (!budget.reserve(blockSize))
+            return NULL;
+    }
+
+    char* block = allocateBlock(blockSize);
+    if (block == NULL)
+    {
+        budget.release(blockSize);
+        return NULL;
+    }
+
+    ++allocated;
+    return block;
+}
+
+void SnapshotPool::release(char* block, size_t size)
+{
+    unsigned index = sizeClass(size);
+    std::lock_guard<std::mutex> guard(lock);
+    if (index >= unused.size())
+        unused.resize(index + 1);
+    unused[index].push_back(block);
+}
+
+void SnapshotPool::freeUnused()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (unsigned index = 0; index < unused.size(); ++index)
+    {
+        size_t blockSize = classSize(index);
+        for (unsigned block = 0; block < unused[index].size(); ++block)
+        {
+            freeBlock(unused[index][block], blockSize);
+            budget.release(blockSize);
+        }
+        unused[index].clear();
+    }
+}
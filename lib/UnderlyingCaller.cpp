@@ -75,7 +75,54 @@ UnderlyingCaller::UnderlyingCaller()
     SET_FCN_PTR(clSetKernelArg)
     SET_FCN_PTR(clEnqueueNDRangeKernel)
     SET_FCN_PTR(clGetKernelInfo)
+#ifdef CL_VERSION_1_2
+    SET_FCN_PTR(clGetKernelArgInfo)
+#endif
+    SET_FCN_PTR(clGetCommandQueueInfo)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    // Deprecated in OpenCL 2.0
+    SET_FCN_PTR(clCreateCommandQueue)
+#pragma GCC diagnostic pop
+    SET_FCN_PTR(clReleaseCommandQueue)
+    SET_FCN_PTR(clGetDeviceInfo)
     SET_FCN_PTR(clEnqueueReadBuffer)
+    SET_FCN_PTR(clRetainEvent)
+    SET_FCN_PTR(clReleaseEvent)
+    SET_FCN_PTR(clWaitForEvents)
+    SET_FCN_PTR(clFlush)
+    SET_FCN_PTR(clRetainMemObject)
+    SET_FCN_PTR(clReleaseMemObject)
+
+#ifdef CL_VERSION_1_1
+    SET_FCN_PTR(clSetMemObjectDestructorCallback)
+#endif
+
+    SET_FCN_PTR(clRetainSampler)
+    SET_FCN_PTR(clReleaseSampler)
+    SET_FCN_PTR(clRetainProgram)
+    SET_FCN_PTR(clReleaseProgram)
+    SET_FCN_PTR(clRetainKernel)
+    SET_FCN_PTR(clReleaseKernel)
+
+    SET_FCN_PTR(clEnqueueWriteBuffer)
+    SET_FCN_PTR(clEnqueueCopyBuffer)
+#ifdef CL_VERSION_1_1
+    SET_FCN_PTR(clEnqueueWriteBufferRect)
+    SET_FCN_PTR(clEnqueueCopyBufferRect)
+#endif
+#ifdef CL_VERSION_1_2
+    SET_FCN_PTR(clEnqueueFillBuffer)
+    SET_FCN_PTR(clEnqueueMigrateMemObjects)
+    SET_FCN_PTR(clEnqueueMarkerWithWaitList)
+    SET_FCN_PTR(clCreateUserEvent)
+    SET_FCN_PTR(clSetUserEventStatus)
+#endif
+    SET_FCN_PTR(clEnqueueCopyImageToBuffer)
+    SET_FCN_PTR(clEnqueueMapBuffer)
+    SET_FCN_PTR(clEnqueueUnmapMemObject)
+    SET_FCN_PTR(clEnqueueTask)
+    SET_FCN_PTR(clEnqueueNativeKernel)
 };
 
 UnderlyingCaller& UnderlyingCaller::Singleton()
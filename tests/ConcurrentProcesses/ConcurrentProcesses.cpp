@@ -0,0 +1,342 @@
+//
+//
+// Book:      OpenCL(R) Programming Guide
+// Authors:   Aaftab Munshi, Benedict Gaster, Timothy Mattson, James Fung, Dan Ginsburg
+// ISBN-10:   0-321-74964-2
+// ISBN-13:   978-0-321-74964-2
+// Publisher: Addison-Wesley Professional
+// URLs:      http://safari.informit.com/9780132488006/
+//            http://www.openclprogrammingguide.com
+//
+
+// ConcurrentProcesses.cpp
+//
+//    Many processes sharing the same GVKI_ROOT start logging at the same
+//    time. Each one must get its own gvki-N directory and together they
+//    must use exactly gvki-0 ... gvki-<NUM_PROCESSES - 1>. Every process
+//    does exactly the same work so whichever one ends up with gvki-0
+//    produces the same log.
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#ifdef MACRO_LIB
+#include "gvki_macro_header.h"
+#endif
+
+///
+//  Constants
+//
+const int ARRAY_SIZE = 64;
+const int NUM_PROCESSES = 500;
+
+///
+//  Create an OpenCL context on the first available platform using
+//  either a GPU or CPU depending on what is available.
+//
+cl_context CreateContext()
+{
+    cl_int errNum;
+    cl_uint numPlatforms;
+    cl_platform_id firstPlatformId;
+    cl_context context = NULL;
+
+    // First, select an OpenCL platform to run on.  For this example, we
+    // simply choose the first available platform.  Normally, you would
+    // query for all available platforms and select the most appropriate one.
+    errNum = clGetPlatformIDs(1, &firstPlatformId, &numPlatforms);
+    if (errNum != CL_SUCCESS || numPlatforms <= 0)
+    {
+        std::cerr << "Failed to find any OpenCL platforms." << std::endl;
+        return NULL;
+    }
+
+    // Next, create an OpenCL context on the platform.  Attempt to
+    // create a GPU-based context, and if that fails, try to create
+    // a CPU-based context.
+    cl_context_properties contextProperties[] =
+    {
+        CL_CONTEXT_PLATFORM,
+        (cl_context_properties)firstPlatformId,
+        0
+    };
+    context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_GPU,
+                                      NULL, NULL, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cout << "Could not create GPU context, trying CPU..." << std::endl;
+        context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_CPU,
+                                          NULL, NULL, &errNum);
+        if (errNum != CL_SUCCESS)
+        {
+            std::cerr << "Failed to create an OpenCL GPU or CPU context." << std::endl;
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+///
+//  Get the first device available on the context
+//
+cl_device_id GetFirstDevice(cl_context context)
+{
+    cl_int errNum;
+    cl_device_id *devices;
+    cl_device_id device = NULL;
+    size_t deviceBufferSize = -1;
+
+    // First get the size of the devices buffer
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBufferSize);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed call to clGetContextInfo(...,GL_CONTEXT_DEVICES,...)";
+        return NULL;
+    }
+
+    if (deviceBufferSize <= 0)
+    {
+        std::cerr << "No devices available.";
+        return NULL;
+    }
+
+    // Allocate memory for the devices buffer
+    devices = new cl_device_id[deviceBufferSize / sizeof(cl_device_id)];
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceBufferSize, devices, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        delete [] devices;
+        std::cerr << "Failed to get device IDs";
+        return NULL;
+    }
+
+    device = devices[0];
+    delete [] devices;
+    return device;
+}
+
+///
+//  Create an OpenCL program from the kernel source file
+//
+cl_program CreateProgram(cl_context context, cl_device_id device, const char* fileName)
+{
+    cl_int errNum;
+    cl_program program;
+
+    std::ifstream kernelFile(fileName, std::ios::in);
+    if (!kernelFile.is_open())
+    {
+        std::cerr << "Failed to open file for reading: " << fileName << std::endl;
+        return NULL;
+    }
+
+    std::ostringstream oss;
+    oss << kernelFile.rdbuf();
+
+    std::string srcStdStr = oss.str();
+    const char *srcStr = srcStdStr.c_str();
+    program = clCreateProgramWithSource(context, 1,
+                                        (const char**)&srcStr,
+                                        NULL, NULL);
+    if (program == NULL)
+    {
+        std::cerr << "Failed to create CL program from source." << std::endl;
+        return NULL;
+    }
+
+    errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        // Determine the reason for the error
+        char buildLog[16384];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                              sizeof(buildLog), buildLog, NULL);
+
+        std::cerr << "Error in kernel: " << std::endl;
+        std::cerr << buildLog;
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+///
+//  The work done by each process. Returns true if everything worked.
+//
+bool RunSquare()
+{
+    cl_int errNum;
+
+    cl_context context = CreateContext();
+    if (context == NULL)
+    {
+        std::cerr << "Failed to create OpenCL context." << std::endl;
+        return false;
+    }
+
+    cl_device_id device = GetFirstDevice(context);
+    if (device == NULL)
+    {
+        clReleaseContext(context);
+        return false;
+    }
+
+    cl_program program = CreateProgram(context, device, "ConcurrentProcesses.cl");
+    if (program == NULL)
+    {
+        clReleaseContext(context);
+        return false;
+    }
+
+    cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create commandQueue" << std::endl;
+        return false;
+    }
+
+    cl_kernel kernel = clCreateKernel(program, "square", &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create kernel" << std::endl;
+        return false;
+    }
+
+    float a[ARRAY_SIZE];
+    float result[ARRAY_SIZE];
+    for (int i = 0; i < ARRAY_SIZE; i++)
+        a[i] = (float)i;
+
+    cl_mem input = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                  sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    cl_mem output = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+                                   sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    if (input == NULL || output == NULL)
+    {
+        std::cerr << "Error creating memory objects." << std::endl;
+        return false;
+    }
+
+    errNum = clEnqueueWriteBuffer(commandQueue, input, CL_TRUE, 0,
+                                  sizeof(float) * ARRAY_SIZE, a, 0, NULL, NULL);
+
+    int n = ARRAY_SIZE;
+    errNum |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+    errNum |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+    errNum |= clSetKernelArg(kernel, 2, sizeof(int), &n);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return false;
+    }
+
+    size_t globalWorkSize[1] = { ARRAY_SIZE };
+    errNum = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL,
+                                    globalWorkSize, NULL,
+                                    0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error queuing kernel for execution." << std::endl;
+        return false;
+    }
+
+    errNum = clEnqueueReadBuffer(commandQueue, output, CL_TRUE,
+                                 0, ARRAY_SIZE * sizeof(float), result,
+                                 0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error reading result buffer." << std::endl;
+        return false;
+    }
+
+    clReleaseMemObject(input);
+    clReleaseMemObject(output);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(commandQueue);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+    return true;
+}
+
+///
+//  Check gvki-0 ... gvki-<NUM_PROCESSES - 1> exist and nothing after them
+//
+bool CheckDirectories()
+{
+    const char* root = getenv("GVKI_ROOT");
+    if (root == NULL)
+    {
+        std::cerr << "GVKI_ROOT is not set." << std::endl;
+        return false;
+    }
+
+    for (int i = 0; i <= NUM_PROCESSES; i++)
+    {
+        std::ostringstream path;
+        path << root << "/gvki-" << i;
+        struct stat info;
+        bool exists = stat(path.str().c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        if (exists != (i < NUM_PROCESSES))
+        {
+            std::cerr << path.str() << (exists ? " should not exist." : " is missing.") << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+//	main() for ConcurrentProcesses example
+//
+int main(int argc, char** argv)
+{
+    // Fork before touching OpenCL so every process starts logging
+    // from scratch. This process does the same work as the others.
+    pid_t children[NUM_PROCESSES - 1];
+    for (int i = 0; i < NUM_PROCESSES - 1; i++)
+    {
+        children[i] = fork();
+        if (children[i] == -1)
+        {
+            std::cerr << "Failed to fork." << std::endl;
+            return 1;
+        }
+
+        if (children[i] == 0)
+            exit(RunSquare() ? 0 : 1);
+    }
+
+    bool allSucceeded = RunSquare();
+    for (int i = 0; i < NUM_PROCESSES - 1; i++)
+    {
+        int status;
+        if (waitpid(children[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            allSucceeded = false;
+    }
+
+    if (!allSucceeded)
+    {
+        std::cerr << "A process failed." << std::endl;
+        return 1;
+    }
+
+    if (!CheckDirectories())
+        return 1;
+
+    std::cout << "Executed program succesfully." << std::endl;
+    return 0;
+}
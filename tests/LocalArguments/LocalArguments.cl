@@ -0,0 +1,14 @@
+__kernel void partial_sums(__global const float* data, __local float2* scratch,
+                           __global float* sums, int n)
+{
+    size_t lid = get_local_id(0);
+    scratch[lid] = (float2)(data[get_global_id(0)], 0.0f);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0 && sums != 0)
+    {
+        float total = 0.0f;
+        for (int i = 0; i < n; ++i)
+            total += scratch[i].x;
+        sums[get_group_id(0)] = total;
+    }
+}
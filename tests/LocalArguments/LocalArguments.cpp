@@ -0,0 +1,253 @@
+//
+//
+// Book:      OpenCL(R) Programming Guide
+// Authors:   Aaftab Munshi, Benedict Gaster, Timothy Mattson, James Fung, Dan Ginsburg
+// ISBN-10:   0-321-74964-2
+// ISBN-13:   978-0-321-74964-2
+// Publisher: Addison-Wesley Professional
+// URLs:      http://safari.informit.com/9780132488006/
+//            http://www.openclprogrammingguide.com
+//
+
+// LocalArguments.cpp
+//
+//    Passes a __local argument whose size is the same as a handle's and
+//    a NULL buffer for a __global argument. The program is built with
+//    -cl-kernel-arg-info so the log can use the declarations rather than
+//    guessing from the values.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#ifdef MACRO_LIB
+#include "gvki_macro_header.h"
+#endif
+
+///
+//  Constants
+//
+const int ARRAY_SIZE = 16;
+const int GROUP_SIZE = 4;
+
+///
+//  Create an OpenCL context on the first available platform using
+//  either a GPU or CPU depending on what is available.
+//
+cl_context CreateContext()
+{
+    cl_int errNum;
+    cl_uint numPlatforms;
+    cl_platform_id firstPlatformId;
+    cl_context context = NULL;
+
+    // First, select an OpenCL platform to run on.  For this example, we
+    // simply choose the first available platform.  Normally, you would
+    // query for all available platforms and select the most appropriate one.
+    errNum = clGetPlatformIDs(1, &firstPlatformId, &numPlatforms);
+    if (errNum != CL_SUCCESS || numPlatforms <= 0)
+    {
+        std::cerr << "Failed to find any OpenCL platforms." << std::endl;
+        return NULL;
+    }
+
+    // Next, create an OpenCL context on the platform.  Attempt to
+    // create a GPU-based context, and if that fails, try to create
+    // a CPU-based context.
+    cl_context_properties contextProperties[] =
+    {
+        CL_CONTEXT_PLATFORM,
+        (cl_context_properties)firstPlatformId,
+        0
+    };
+    context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_GPU,
+                                      NULL, NULL, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cout << "Could not create GPU context, trying CPU..." << std::endl;
+        context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_CPU,
+                                          NULL, NULL, &errNum);
+        if (errNum != CL_SUCCESS)
+        {
+            std::cerr << "Failed to create an OpenCL GPU or CPU context." << std::endl;
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+///
+//  Get the first device available on the context
+//
+cl_device_id GetFirstDevice(cl_context context)
+{
+    cl_int errNum;
+    cl_device_id *devices;
+    cl_device_id device = NULL;
+    size_t deviceBufferSize = -1;
+
+    // First get the size of the devices buffer
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBufferSize);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed call to clGetContextInfo(...,GL_CONTEXT_DEVICES,...)";
+        return NULL;
+    }
+
+    if (deviceBufferSize <= 0)
+    {
+        std::cerr << "No devices available.";
+        return NULL;
+    }
+
+    // Allocate memory for the devices buffer
+    devices = new cl_device_id[deviceBufferSize / sizeof(cl_device_id)];
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceBufferSize, devices, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        delete [] devices;
+        std::cerr << "Failed to get device IDs";
+        return NULL;
+    }
+
+    device = devices[0];
+    delete [] devices;
+    return device;
+}
+
+///
+//  Create an OpenCL program from the kernel source file
+//
+cl_program CreateProgram(cl_context context, cl_device_id device, const char* fileName)
+{
+    cl_int errNum;
+    cl_program program;
+
+    std::ifstream kernelFile(fileName, std::ios::in);
+    if (!kernelFile.is_open())
+    {
+        std::cerr << "Failed to open file for reading: " << fileName << std::endl;
+        return NULL;
+    }
+
+    std::ostringstream oss;
+    oss << kernelFile.rdbuf();
+
+    std::string srcStdStr = oss.str();
+    const char *srcStr = srcStdStr.c_str();
+    program = clCreateProgramWithSource(context, 1,
+                                        (const char**)&srcStr,
+                                        NULL, NULL);
+    if (program == NULL)
+    {
+        std::cerr << "Failed to create CL program from source." << std::endl;
+        return NULL;
+    }
+
+    errNum = clBuildProgram(program, 0, NULL, "-cl-kernel-arg-info", NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        // Determine the reason for the error
+        char buildLog[16384];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                              sizeof(buildLog), buildLog, NULL);
+
+        std::cerr << "Error in kernel: " << std::endl;
+        std::cerr << buildLog;
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+///
+//	main() for LocalArguments example
+//
+int main(int argc, char** argv)
+{
+    cl_int errNum;
+
+    cl_context context = CreateContext();
+    if (context == NULL)
+    {
+        std::cerr << "Failed to create OpenCL context." << std::endl;
+        return 1;
+    }
+
+    cl_device_id device = GetFirstDevice(context);
+    if (device == NULL)
+        return 1;
+
+    cl_program program = CreateProgram(context, device, "LocalArguments.cl");
+    if (program == NULL)
+        return 1;
+
+    cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create commandQueue" << std::endl;
+        return 1;
+    }
+
+    cl_kernel kernel = clCreateKernel(program, "partial_sums", &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create kernel" << std::endl;
+        return 1;
+    }
+
+    float a[ARRAY_SIZE];
+    for (int i = 0; i < ARRAY_SIZE; i++)
+        a[i] = (float)i;
+
+    cl_mem data = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                 sizeof(float) * ARRAY_SIZE, a, &errNum);
+    if (data == NULL)
+    {
+        std::cerr << "Error creating memory object." << std::endl;
+        return 1;
+    }
+
+    // One float2 per work item, which happens to be the size of a handle
+    int n = GROUP_SIZE;
+    cl_mem noSums = NULL;
+    errNum = clSetKernelArg(kernel, 0, sizeof(cl_mem), &data);
+    errNum |= clSetKernelArg(kernel, 1, 2 * sizeof(float), NULL);
+    errNum |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &noSums);
+    errNum |= clSetKernelArg(kernel, 3, sizeof(int), &n);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return 1;
+    }
+
+    size_t globalWorkSize[1] = { ARRAY_SIZE };
+    size_t localWorkSize[1] = { GROUP_SIZE };
+    errNum = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL,
+                                    globalWorkSize, localWorkSize,
+                                    0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error queuing kernel for execution." << std::endl;
+        return 1;
+    }
+
+    clFinish(commandQueue);
+
+    clReleaseMemObject(data);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(commandQueue);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+
+    std::cout << "Executed program succesfully." << std::endl;
+    return 0;
+}
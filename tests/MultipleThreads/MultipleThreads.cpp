@@ -0,0 +1,313 @@
+//
+//
+// Book:      OpenCL(R) Programming Guide
+// Authors:   Aaftab Munshi, Benedict Gaster, Timothy Mattson, James Fung, Dan Ginsburg
+// ISBN-10:   0-321-74964-2
+// ISBN-13:   978-0-321-74964-2
+// Publisher: Addison-Wesley Professional
+// URLs:      http://safari.informit.com/9780132488006/
+//            http://www.openclprogrammingguide.com
+//
+
+// MultipleThreads.cpp
+//
+//    Several threads, each with their own command queue, concurrently
+//    create buffers and kernels, set kernel arguments and enqueue kernels.
+//    Every thread does exactly the same work so the log should contain
+//    identical entries regardless of how the threads are scheduled.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#ifdef MACRO_LIB
+#include "gvki_macro_header.h"
+#endif
+
+///
+//  Constants
+//
+const int ARRAY_SIZE = 64;
+const int NUM_THREADS = 8;
+// Extra buffers each thread creates so the threads
+// register lots of objects at the same time
+const int NUM_EXTRA_BUFFERS = 500;
+
+///
+//  Create an OpenCL context on the first available platform using
+//  either a GPU or CPU depending on what is available.
+//
+cl_context CreateContext()
+{
+    cl_int errNum;
+    cl_uint numPlatforms;
+    cl_platform_id firstPlatformId;
+    cl_context context = NULL;
+
+    // First, select an OpenCL platform to run on.  For this example, we
+    // simply choose the first available platform.  Normally, you would
+    // query for all available platforms and select the most appropriate one.
+    errNum = clGetPlatformIDs(1, &firstPlatformId, &numPlatforms);
+    if (errNum != CL_SUCCESS || numPlatforms <= 0)
+    {
+        std::cerr << "Failed to find any OpenCL platforms." << std::endl;
+        return NULL;
+    }
+
+    // Next, create an OpenCL context on the platform.  Attempt to
+    // create a GPU-based context, and if that fails, try to create
+    // a CPU-based context.
+    cl_context_properties contextProperties[] =
+    {
+        CL_CONTEXT_PLATFORM,
+        (cl_context_properties)firstPlatformId,
+        0
+    };
+    context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_GPU,
+                                      NULL, NULL, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cout << "Could not create GPU context, trying CPU..." << std::endl;
+        context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_CPU,
+                                          NULL, NULL, &errNum);
+        if (errNum != CL_SUCCESS)
+        {
+            std::cerr << "Failed to create an OpenCL GPU or CPU context." << std::endl;
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+///
+//  Get the first device available on the context
+//
+cl_device_id GetFirstDevice(cl_context context)
+{
+    cl_int errNum;
+    cl_device_id *devices;
+    cl_device_id device = NULL;
+    size_t deviceBufferSize = -1;
+
+    // First get the size of the devices buffer
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBufferSize);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed call to clGetContextInfo(...,GL_CONTEXT_DEVICES,...)";
+        return NULL;
+    }
+
+    if (deviceBufferSize <= 0)
+    {
+        std::cerr << "No devices available.";
+        return NULL;
+    }
+
+    // Allocate memory for the devices buffer
+    devices = new cl_device_id[deviceBufferSize / sizeof(cl_device_id)];
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceBufferSize, devices, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        delete [] devices;
+        std::cerr << "Failed to get device IDs";
+        return NULL;
+    }
+
+    device = devices[0];
+    delete [] devices;
+    return device;
+}
+
+///
+//  Create an OpenCL program from the kernel source file
+//
+cl_program CreateProgram(cl_context context, cl_device_id device, const char* fileName)
+{
+    cl_int errNum;
+    cl_program program;
+
+    std::ifstream kernelFile(fileName, std::ios::in);
+    if (!kernelFile.is_open())
+    {
+        std::cerr << "Failed to open file for reading: " << fileName << std::endl;
+        return NULL;
+    }
+
+    std::ostringstream oss;
+    oss << kernelFile.rdbuf();
+
+    std::string srcStdStr = oss.str();
+    const char *srcStr = srcStdStr.c_str();
+    program = clCreateProgramWithSource(context, 1,
+                                        (const char**)&srcStr,
+                                        NULL, NULL);
+    if (program == NULL)
+    {
+        std::cerr << "Failed to create CL program from source." << std::endl;
+        return NULL;
+    }
+
+    errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        // Determine the reason for the error
+        char buildLog[16384];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                              sizeof(buildLog), buildLog, NULL);
+
+        std::cerr << "Error in kernel: " << std::endl;
+        std::cerr << buildLog;
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+///
+//  The work done by each thread. Sets *success if everything worked.
+//
+void RunSquare(cl_context context, cl_device_id device, cl_program program, bool* success)
+{
+    cl_int errNum;
+    *success = false;
+
+    cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create commandQueue" << std::endl;
+        return;
+    }
+
+    cl_kernel kernel = clCreateKernel(program, "square", &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create kernel" << std::endl;
+        clReleaseCommandQueue(commandQueue);
+        return;
+    }
+
+    std::vector<cl_mem> extraBuffers;
+    for (int i = 0; i < NUM_EXTRA_BUFFERS; i++)
+    {
+        cl_mem extra = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float), NULL, &errNum);
+        if (errNum == CL_SUCCESS)
+            extraBuffers.push_back(extra);
+    }
+
+    float a[ARRAY_SIZE];
+    float result[ARRAY_SIZE];
+    for (int i = 0; i < ARRAY_SIZE; i++)
+        a[i] = (float)i;
+
+    cl_mem input = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                  sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    cl_mem output = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+                                   sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    if (input == NULL || output == NULL)
+    {
+        std::cerr << "Error creating memory objects." << std::endl;
+        return;
+    }
+
+    errNum = clEnqueueWriteBuffer(commandQueue, input, CL_TRUE, 0,
+                                  sizeof(float) * ARRAY_SIZE, a, 0, NULL, NULL);
+
+    int n = ARRAY_SIZE;
+    errNum |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+    errNum |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+    errNum |= clSetKernelArg(kernel, 2, sizeof(int), &n);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return;
+    }
+
+    size_t globalWorkSize[1] = { ARRAY_SIZE };
+    errNum = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL,
+                                    globalWorkSize, NULL,
+                                    0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error queuing kernel for execution." << std::endl;
+        return;
+    }
+
+    errNum = clEnqueueReadBuffer(commandQueue, output, CL_TRUE,
+                                 0, ARRAY_SIZE * sizeof(float), result,
+                                 0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error reading result buffer." << std::endl;
+        return;
+    }
+
+    for (size_t i = 0; i < extraBuffers.size(); i++)
+        clReleaseMemObject(extraBuffers[i]);
+
+    clReleaseMemObject(input);
+    clReleaseMemObject(output);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(commandQueue);
+    *success = true;
+}
+
+///
+//	main() for MultipleThreads example
+//
+int main(int argc, char** argv)
+{
+    cl_context context = CreateContext();
+    if (context == NULL)
+    {
+        std::cerr << "Failed to create OpenCL context." << std::endl;
+        return 1;
+    }
+
+    cl_device_id device = GetFirstDevice(context);
+    if (device == NULL)
+    {
+        clReleaseContext(context);
+        return 1;
+    }
+
+    cl_program program = CreateProgram(context, device, "MultipleThreads.cl");
+    if (program == NULL)
+    {
+        clReleaseContext(context);
+        return 1;
+    }
+
+    bool success[NUM_THREADS];
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_THREADS; i++)
+        threads.push_back(std::thread(RunSquare, context, device, program, &success[i]));
+
+    bool allSucceeded = true;
+    for (int i = 0; i < NUM_THREADS; i++)
+    {
+        threads[i].join();
+        allSucceeded = allSucceeded && success[i];
+    }
+
+    clReleaseProgram(program);
+    clReleaseContext(context);
+
+    if (!allSucceeded)
+    {
+        std::cerr << "A thread failed." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Executed program succesfully." << std::endl;
+    return 0;
+}
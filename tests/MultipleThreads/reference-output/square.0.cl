@@ -0,0 +1,6 @@
+__kernel void square(__global const float* a, __global float* result, int n)
+{
+    size_t gid = get_global_id(0);
+    if (gid < n)
+        result[gid] = a[gid] * a[gid];
+}
@@ -0,0 +1,6 @@
+__kernel void square(__global float* data, int n)
+{
+    size_t gid = get_global_id(0);
+    if (gid < n)
+        data[gid] = data[gid] * data[gid];
+}
@@ -0,0 +1,311 @@
+//
+//
+// Book:      OpenCL(R) Programming Guide
+// Authors:   Aaftab Munshi, Benedict Gaster, Timothy Mattson, James Fung, Dan Ginsburg
+// ISBN-10:   0-321-74964-2
+// ISBN-13:   978-0-321-74964-2
+// Publisher: Addison-Wesley Professional
+// URLs:      http://safari.informit.com/9780132488006/
+//            http://www.openclprogrammingguide.com
+//
+
+// RewriteBuffers.cpp
+//
+//    Passes the same input buffer to several invocations, changing its
+//    contents between some of them with clEnqueueWriteBuffer() and
+//    clEnqueueCopyBuffer(). A snapshot of the buffer may only be reused
+//    by an invocation if nothing has written to the buffer since it was
+//    taken, so each invocation must be logged with the contents the
+//    buffer had when it was enqueued.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#ifdef MACRO_LIB
+#include "gvki_macro_header.h"
+#endif
+
+///
+//  Constants
+//
+const int ARRAY_SIZE = 64;
+
+///
+//  Create an OpenCL context on the first available platform using
+//  either a GPU or CPU depending on what is available.
+//
+cl_context CreateContext()
+{
+    cl_int errNum;
+    cl_uint numPlatforms;
+    cl_platform_id firstPlatformId;
+    cl_context context = NULL;
+
+    // First, select an OpenCL platform to run on.  For this example, we
+    // simply choose the first available platform.  Normally, you would
+    // query for all available platforms and select the most appropriate one.
+    errNum = clGetPlatformIDs(1, &firstPlatformId, &numPlatforms);
+    if (errNum != CL_SUCCESS || numPlatforms <= 0)
+    {
+        std::cerr << "Failed to find any OpenCL platforms." << std::endl;
+        return NULL;
+    }
+
+    // Next, create an OpenCL context on the platform.  Attempt to
+    // create a GPU-based context, and if that fails, try to create
+    // a CPU-based context.
+    cl_context_properties contextProperties[] =
+    {
+        CL_CONTEXT_PLATFORM,
+        (cl_context_properties)firstPlatformId,
+        0
+    };
+    context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_GPU,
+                                      NULL, NULL, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cout << "Could not create GPU context, trying CPU..." << std::endl;
+        context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_CPU,
+                                          NULL, NULL, &errNum);
+        if (errNum != CL_SUCCESS)
+        {
+            std::cerr << "Failed to create an OpenCL GPU or CPU context." << std::endl;
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+///
+//  Get the first device available on the context
+//
+cl_device_id GetFirstDevice(cl_context context)
+{
+    cl_int errNum;
+    cl_device_id *devices;
+    cl_device_id device = NULL;
+    size_t deviceBufferSize = -1;
+
+    // First get the size of the devices buffer
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBufferSize);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed call to clGetContextInfo(...,GL_CONTEXT_DEVICES,...)";
+        return NULL;
+    }
+
+    if (deviceBufferSize <= 0)
+    {
+        std::cerr << "No devices available.";
+        return NULL;
+    }
+
+    // Allocate memory for the devices buffer
+    devices = new cl_device_id[deviceBufferSize / sizeof(cl_device_id)];
+    errNum = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceBufferSize, devices, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        delete [] devices;
+        std::cerr << "Failed to get device IDs";
+        return NULL;
+    }
+
+    device = devices[0];
+    delete [] devices;
+    return device;
+}
+
+///
+//  Create an OpenCL program from the kernel source file
+//
+cl_program CreateProgram(cl_context context, cl_device_id device, const char* fileName)
+{
+    cl_int errNum;
+    cl_program program;
+
+    std::ifstream kernelFile(fileName, std::ios::in);
+    if (!kernelFile.is_open())
+    {
+        std::cerr << "Failed to open file for reading: " << fileName << std::endl;
+        return NULL;
+    }
+
+    std::ostringstream oss;
+    oss << kernelFile.rdbuf();
+
+    std::string srcStdStr = oss.str();
+    const char *srcStr = srcStdStr.c_str();
+    program = clCreateProgramWithSource(context, 1,
+                                        (const char**)&srcStr,
+                                        NULL, NULL);
+    if (program == NULL)
+    {
+        std::cerr << "Failed to create CL program from source." << std::endl;
+        return NULL;
+    }
+
+    errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        // Determine the reason for the error
+        char buildLog[16384];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                              sizeof(buildLog), buildLog, NULL);
+
+        std::cerr << "Error in kernel: " << std::endl;
+        std::cerr << buildLog;
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+///
+//  Create a kernel and enqueue it on ``in`` and ``out``
+//
+bool RunKernel(cl_command_queue commandQueue, cl_program program, cl_mem in, cl_mem out, int n)
+{
+    cl_int errNum;
+
+    // Only the first invocation of a kernel is logged so
+    // each invocation uses a new one
+    cl_kernel kernel = clCreateKernel(program, "scale", &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create kernel" << std::endl;
+        return false;
+    }
+
+    errNum = clSetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+    errNum |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+    errNum |= clSetKernelArg(kernel, 2, sizeof(int), &n);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return false;
+    }
+
+    size_t globalWorkSize[1] = { (size_t) n };
+    errNum = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL,
+                                    globalWorkSize, NULL,
+                                    0, NULL, NULL);
+    clReleaseKernel(kernel);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error queuing kernel for execution." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+///
+//	main() for RewriteBuffers example
+//
+int main(int argc, char** argv)
+{
+    cl_int errNum;
+
+    cl_context context = CreateContext();
+    if (context == NULL)
+    {
+        std::cerr << "Failed to create OpenCL context." << std::endl;
+        return 1;
+    }
+
+    cl_device_id device = GetFirstDevice(context);
+    if (device == NULL)
+        return 1;
+
+    cl_program program = CreateProgram(context, device, "RewriteBuffers.cl");
+    if (program == NULL)
+        return 1;
+
+    cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &errNum);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Failed to create commandQueue" << std::endl;
+        return 1;
+    }
+
+    float a[ARRAY_SIZE];
+    float b[ARRAY_SIZE];
+    for (int i = 0; i < ARRAY_SIZE; i++)
+    {
+        a[i] = (float)i;
+        b[i] = (float)(ARRAY_SIZE - i);
+    }
+
+    cl_mem in = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                               sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    cl_mem other = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                  sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    cl_mem out = clCreateBuffer(context, CL_MEM_READ_WRITE,
+                                sizeof(float) * ARRAY_SIZE, NULL, &errNum);
+    if (in == NULL || other == NULL || out == NULL)
+    {
+        std::cerr << "Error creating memory objects." << std::endl;
+        return 1;
+    }
+
+    errNum = clEnqueueWriteBuffer(commandQueue, in, CL_TRUE, 0,
+                                  sizeof(float) * ARRAY_SIZE, a, 0, NULL, NULL);
+    errNum |= clEnqueueWriteBuffer(commandQueue, other, CL_TRUE, 0,
+                                   sizeof(float) * ARRAY_SIZE, a, 0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error writing buffers." << std::endl;
+        return 1;
+    }
+
+    // The first two invocations see ``a``
+    if (!RunKernel(commandQueue, program, in, out, ARRAY_SIZE) ||
+        !RunKernel(commandQueue, program, in, out, ARRAY_SIZE))
+        return 1;
+
+    // The next two see ``b``
+    errNum = clEnqueueWriteBuffer(commandQueue, in, CL_TRUE, 0,
+                                  sizeof(float) * ARRAY_SIZE, b, 0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error writing buffer." << std::endl;
+        return 1;
+    }
+
+    if (!RunKernel(commandQueue, program, in, out, ARRAY_SIZE) ||
+        !RunKernel(commandQueue, program, in, out, ARRAY_SIZE))
+        return 1;
+
+    // The last sees ``a`` again
+    errNum = clEnqueueCopyBuffer(commandQueue, other, in, 0, 0,
+                                 sizeof(float) * ARRAY_SIZE, 0, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        std::cerr << "Error copying buffer." << std::endl;
+        return 1;
+    }
+
+    if (!RunKernel(commandQueue, program, in, out, ARRAY_SIZE))
+        return 1;
+
+    clFinish(commandQueue);
+
+    clReleaseMemObject(in);
+    clReleaseMemObject(other);
+    clReleaseMemObject(out);
+    clReleaseCommandQueue(commandQueue);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+
+    std::cout << "Executed program succesfully." << std::endl;
+    return 0;
+}
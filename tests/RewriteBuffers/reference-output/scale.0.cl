@@ -0,0 +1,6 @@
+__kernel void scale(__global const float* in, __global float* out, int n)
+{
+    size_t gid = get_global_id(0);
+    if (gid < n)
+        out[gid] = 2.0f * in[gid];
+}
@@ -22,6 +22,20 @@ import subprocess
 import shutil
 import sys
 
+# Files written by GVKI whose contents depend on the machine
+machineDependentFiles = set(['devices.json'])
+
+# The fields of each device in devices.json and the type of their values
+deviceFields = {
+    'id': int,
+    'name': type(u''),
+    'vendor': type(u''),
+    'driver_version': type(u''),
+    'endianness': type(u''),
+    'address_bits': int,
+    'max_work_group_size': int,
+}
+
 def printError(msg):
     logging.error('\033[0;31m*** {} ***\033[0m'.format(msg))
 
@@ -84,6 +98,13 @@ class LibTest(object):
                 printError('Could not parse JSON file "{}". {}'.format(expectedJSONFile, str(e)))
                 return 1
 
+        # The device table can't be compared against a reference (see below)
+        # so check it makes sense and agrees with the log instead
+        error = self._checkDeviceTable(gvkiOutputDir, parsed)
+        if error is not None:
+            printError('{} failed. {}'.format(self.path, error))
+            return 1
+
         # There should be at least one kernel
         recordedKernels=glob.glob(gvkiOutputDir + os.path.sep + '*.cl')
         logging.info('Recorded kernels: {}'.format(recordedKernels))
@@ -99,6 +120,10 @@ class LibTest(object):
         filesToCompare = set(f for f in os.listdir(self.referenceOutputDir) if os.path.isfile( os.path.join(self.referenceOutputDir, f)) )
         files = set(f for f in os.listdir(gvkiOutputDir) if os.path.isfile( os.path.join(gvkiOutputDir, f)) )
         filesToCompare = filesToCompare.union(files)
+
+        # The device table describes whatever machine the tests ran on
+        # so it can't be compared against a reference
+        filesToCompare = filesToCompare.difference(machineDependentFiles)
         assert len(filesToCompare) > 0
 
         # Check for mismatching files
@@ -125,6 +150,58 @@ class LibTest(object):
         return 0
 
 
+    def _checkDeviceTable(self, gvkiOutputDir, records):
+        """
+        Returns a description of what is wrong with devices.json or None
+        """
+        tableFile = os.path.join(gvkiOutputDir, 'devices.json')
+        if not os.path.exists(tableFile):
+            return 'Device table is missing'
+
+        with open(tableFile) as f:
+            try:
+                table = json.load(f)
+            except Exception as e:
+                return 'Could not parse device table "{}". {}'.format(tableFile, str(e))
+
+        if not isinstance(table, list):
+            return 'Device table is not an array'
+
+        devices = { }
+        for device in table:
+            if not isinstance(device, dict) or set(device.keys()) != set(deviceFields.keys()):
+                return 'Device {} does not have the fields {}'.format(device, sorted(deviceFields.keys()))
+
+            for (field, fieldType) in deviceFields.items():
+                if not isinstance(device[field], fieldType) or isinstance(device[field], bool):
+                    return 'Device {} has a bad "{}"'.format(device, field)
+
+            if device['id'] in devices:
+                return 'Device id {} is used twice'.format(device['id'])
+            if len(device['name']) == 0 or len(device['vendor']) == 0:
+                return 'Device {} has no name or vendor'.format(device)
+            if device['endianness'] not in ('little', 'big'):
+                return 'Device {} has a bad endianness'.format(device)
+            if device['address_bits'] not in (32, 64):
+                return 'Device {} has a bad address_bits'.format(device)
+            if device['max_work_group_size'] < 1:
+                return 'Device {} has a bad max_work_group_size'.format(device)
+            devices[device['id']] = device
+
+        # Every device a record refers to is in the table
+        for record in records:
+            if 'device' not in record:
+                continue
+
+            device = devices.get(record['device'])
+            if device is None:
+                return 'Kernel "{}" was launched on device {}, which is not in the device table'.format(
+                       record['entry_point'], record['device'])
+            if record['endianness'] != device['endianness']:
+                return 'Kernel "{}" has a different endianness to its device'.format(record['entry_point'])
+
+        return None
+
     # So we can sort tests
     def __lt__(self, other):
         return self.path < other.path
@@ -137,6 +214,15 @@ class MacroLibTest(LibTest):
     def run(self):
         return self._run({})
 
+class TSanLibTest(LibTest):
+    def __init__(self, path):
+        outputDir = os.path.join( os.path.dirname(os.path.abspath(path)), 'gvki_tsan.log.d')
+        super(TSanLibTest, self).__init__(path, outputDir)
+
+    def run(self):
+        # Any data race reported makes the test exit with an error
+        return self._run({ 'TSAN_OPTIONS': 'halt_on_error=1' })
+
 class PreloadLibTest(LibTest):
     def __init__(self, path, libPath):
         outputDir = os.path.join( os.path.dirname(os.path.abspath(path)), 'gvki_preload.log.d')
@@ -194,6 +280,8 @@ def main(args):
                 tests.append( PreloadLibTest( os.path.join(dirpath, f), preloadlibPath))
             elif f.endswith('_gvki_macro'):
                 tests.append( MacroLibTest( os.path.join(dirpath, f)))
+            elif f.endswith('_gvki_tsan'):
+                tests.append( TSanLibTest( os.path.join(dirpath, f)))
 
         # clean up any old output directories
         for directory in dirnames: